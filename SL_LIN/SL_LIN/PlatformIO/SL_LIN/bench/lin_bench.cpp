@@ -0,0 +1,790 @@
+// Стенд пропускной способности декодера LIN. Собирается только в [env:native]:
+//
+//   pio run -e native && .pio/build/native/program [опции] [кадров] [seed] [бод] [autobaud]
+//
+// бод - скорость сигнала и декодера (по умолчанию custom_defs::kLinSpeed, до
+// lin_processor::kMaxBaud). autobaud -
+// режим lin_processor::autobaud_modes (0 - выкл., 1 - стандартные скорости, 2 - точная),
+// тогда декодер сам находит скорость сигнала.
+// При автоопределении первый кадр только измеряется и не ожидается на выходе.
+//
+// Опции трафика (lin_traffic.h), длины в битах:
+//   -g пауза между кадрами (0 - кадры вплотную, загрузка шины 100%), -k длина
+//   разрыва, -j разброс длины разрыва, -d разделитель, -r пауза перед ответом,
+//   -i пауза между байтами ответа;
+//   -n вероятность помехи на бит, -w длина помехи;
+//   -s файл расписания ("ID ДЛИНА" в строке) вместо случайных кадров, -c журнал
+//   lin_capture: кадры и паузы записанного трафика;
+//   -o ascii|binary - модель вывода кадров к хосту на custom_defs::kHostBaud, при
+//   которой очередь приема может переполниться.
+// Набор сценариев регрессии - bench/traffic_suite.sh.
+//
+// Генерирует синтетический сигнал RX (break, sync, PID, данные, контрольная сумма),
+// моделирует Timer2 (быстрый ШИМ, TOP = OCR2A) и Timer1 (x64) в тактах CPU 16 МГц
+// и вызывает обработчик TIMER2_COMPA_vect при каждом совпадении и INT0_vect на
+// выбранном в EICRA фронте RX, пока INT0 разрешен (ожидание стартового бита), либо,
+// при LIN_RX_EDGE_DECODER, INT0_vect на каждом фронте RX и TIMER1_COMPA_vect при
+// совпадении OCR1A. Оба декодера получают один и тот же сигнал. Декодированные
+// кадры сверяются с исходными. Отчет: кадров в секунду и стоимость каждого пути ISR
+// (время хоста и модельные такты AVR, проведенные в циклах ожидания).
+// Декодер выборки платит за каждое прерывание: вход до первой выборки, тело и
+// выход, отдельно - конец байта и конец кадра, и худший случай прерывания UART
+// перед каждым входом в TIMER2_COMPA_vect и INT0. Это оценки по коду, а не
+// измерения на AVR (см. kTimer2IsrCycles). Флаги OCF2A и INTF0 моделируются:
+// совпадение во время долгого ISR обрабатывается после него, два совпадения
+// сливаются в одно, как на AVR. "+ wait" означает, что ISR шел дольше одного бита.
+//
+// Код возврата отличен от нуля, если потерян или искажен хотя бы один кадр без
+// помехи (ExpectedFrame::noisy) или без помех вышел лишний кадр.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <deque>
+#include <random>
+#include <vector>
+
+#include "avr_util.h"
+#include "custom_defs.h"
+#include "hardware_clock.h"
+#include "lin_frame.h"
+#include "lin_ids.h"
+#include "lin_processor.h"
+#include "lin_traffic.h"
+#include "sio.h"
+#include "stats.h"
+#include "system_clock.h"
+
+extern "C" void INT0_vect(void);
+#if LIN_RX_EDGE_DECODER
+extern "C" void TIMER1_COMPA_vect(void);
+#else
+extern "C" void TIMER2_COMPA_vect(void);
+#endif
+
+namespace {
+
+using traffic::kCpuHz;
+
+// Модельная стоимость чтения TCNT1 в тактах CPU (с сохранением отметки). Каждое
+// чтение продвигает модельное время на эту величину.
+const uint32 kCyclesPerWaitIteration = 12;
+
+// То же для чтения PIND (декодер выборки).
+const uint32 kCyclesPerPinRead = 3;
+
+// Расчет периода бита перед записью OCR2A (advanceBitPeriod()). Запись попадает в
+// буфер OCR2A уже после BOTTOM, как на AVR, и действует со следующего периода.
+const uint32 kCyclesPerPeriodUpdate = 10;
+
+// USART_RX_vect или USART_UDRE_vect с входом и выходом, худший случай. Декодер
+// выборки считает, что такое прерывание началось перед каждым входом в
+// TIMER2_COMPA_vect и INT0: выборки и фронт стартового бита опаздывают на него.
+const uint32 kUartIsrCycles = 80;
+
+// Стоимость TIMER2_COMPA_vect декодера выборки сверх задержки входа
+// (kIsrLatencyCycles) и обращений к регистрам, которые стенд считает отдельно
+// (PIND, OCR2A, TCNT1): переходы по состоянию и варианту скорости, счетчики битов,
+// эпилог и reti. Оценка по коду, avr-gcc и AVR для измерения не было.
+const uint32 kTimer2IsrCycles = 60;
+// Дополнительно на выборке стопового бита: вызов handleStopBit(), добавление
+// байта, фильтр ID, поиск в таблице ответов и настройка INT0 (waitNextByte()).
+const uint32 kByteDoneCycles = 120;
+// Дополнительно на тике, который закончил кадр по паузе (endFrame()): validate(),
+// расширение метки времени, статистика и публикация в очереди.
+const uint32 kFrameDoneCycles = 200;
+
+// Бит RX в PIND (см. DEFINE_INPUT_PIN(rx_pin, D, 2) в lin_processor.cpp).
+const uint8 kRxPinMask = H(2);
+
+using traffic::Waveform;
+namespace kinds = traffic::kinds;
+using traffic::kKindNames;
+
+// ----- Модель времени -----
+
+static Waveform* waveform;
+// Модельное время в тактах CPU.
+static uint64_t now_cycles;
+
+#if !LIN_RX_EDGE_DECODER
+// ----- Модель Timer2 -----
+
+static uint32 timer2Prescaler() {
+  switch (native_hal::io[native_hal::addr::kTCCR2B] & (H(CS22) | H(CS21) | H(CS20))) {
+    case H(CS21):
+      return 8;
+    case H(CS21) | H(CS20):
+      return 32;
+    case H(CS22):
+      return 64;
+    default:
+      fprintf(stderr, "Unexpected Timer2 prescaler\n");
+      exit(2);
+  }
+}
+
+// В режиме быстрой ШИМ OCR2A буферизован и становится TOP в BOTTOM.
+static uint8 timer2_top;
+// Такт CPU следующего отсчета Timer2. Счет начинается перед основным циклом стенда.
+static uint64_t timer2_next_count = UINT64_MAX;
+// Флаг OCF2A.
+static boolean timer2_match;
+
+// Отсчеты Timer2 до такта cycle включительно. Совпадение с TOP взводит OCF2A, затем
+// счетчик переходит в ноль. Пределитель может смениться при автоопределении скорости.
+static void runTimer2(uint64_t cycle) {
+  volatile uint8_t& tcnt2 = native_hal::io[native_hal::addr::kTCNT2];
+  while (timer2_next_count <= cycle) {
+    if (tcnt2 == timer2_top) {
+      tcnt2 = 0;
+      timer2_top = native_hal::io[native_hal::addr::kOCR2A];
+    } else {
+      tcnt2 = uint8(tcnt2 + 1);
+    }
+    if (tcnt2 == timer2_top) {
+      timer2_match = true;
+    }
+    timer2_next_count += timer2Prescaler();
+  }
+}
+
+// Неиспользуемый бит TIFR2, которым стенд помечает показанное значение. Прошивка
+// только пишет TIFR2 целиком, поэтому значение без метки - запись: единица в
+// OCF2A сбрасывает флаг.
+const uint8 kTifr2Shown = 0x80;
+
+// Довести Timer2 до now_cycles и показать OCF2A в TIFR2.
+static void syncTimer2() {
+  runTimer2(now_cycles);
+  volatile uint8_t& tifr2 = native_hal::io[native_hal::addr::kTIFR2];
+  if (!(tifr2 & kTifr2Shown) && (tifr2 & H(OCF2A))) {
+    timer2_match = false;
+  }
+  tifr2 = kTifr2Shown | (timer2_match ? H(OCF2A) : 0);
+}
+
+// ----- Модель INT0 -----
+
+// Фронты до этого такта флаг INTF0 уже не взводят: вызван INT0 или флаг сброшен.
+static uint64_t int0_from_cycle;
+// Такт последнего обращения к EIFR. Если это была запись, флаг сброшен в этот такт.
+static uint64_t eifr_access_cycle;
+// Метка показанного значения EIFR, как kTifr2Shown.
+const uint8 kEifrShown = 0x80;
+
+// Такт фронта, выбранного в EICRA, который взвел INTF0, или UINT64_MAX. Флаг
+// взводится и при запрещенном INT0.
+static uint64_t pendingInt0Edge() {
+  const uint8 level = (native_hal::io[native_hal::addr::kEICRA] & H(ISC00)) ? 1 : 0;
+  return waveform->nextEdgeTo(int0_from_cycle, level);
+}
+
+// Учесть запись в EIFR и показать INTF0.
+static void syncInt0() {
+  volatile uint8_t& eifr = native_hal::io[native_hal::addr::kEIFR];
+  if (!(eifr & kEifrShown) && (eifr & H(INTF0))) {
+    int0_from_cycle = eifr_access_cycle;
+  }
+  eifr = kEifrShown | (pendingInt0Edge() <= now_cycles ? H(INTF0) : 0);
+}
+#endif
+
+static void accessHook(uint8_t address) {
+  if (address == native_hal::addr::kTCNT1) {
+    now_cycles += kCyclesPerWaitIteration;
+    *reinterpret_cast<volatile uint16_t*>(&native_hal::io[native_hal::addr::kTCNT1]) = uint16(now_cycles / 64);
+    return;
+  }
+#if LIN_RX_EDGE_DECODER
+  // Стенд вызывает INT0 сразу на фронте, поэтому флаг INTF0 никогда не ожидает.
+  // Запись единицы (сброс флага на AVR) забывается при следующем обращении.
+  if (address == native_hal::addr::kEIFR) {
+    native_hal::io[native_hal::addr::kEIFR] = 0;
+    return;
+  }
+#else
+  if (address == native_hal::addr::kEIFR) {
+    syncInt0();
+    eifr_access_cycle = now_cycles;
+    return;
+  }
+#endif
+  if (address == native_hal::addr::kPIND) {
+    if (waveform->at(now_cycles).level) {
+      native_hal::io[native_hal::addr::kPIND] |= kRxPinMask;
+    } else {
+      native_hal::io[native_hal::addr::kPIND] &= ~kRxPinMask;
+    }
+#if !LIN_RX_EDGE_DECODER
+    now_cycles += kCyclesPerPinRead;
+#endif
+    return;
+  }
+#if !LIN_RX_EDGE_DECODER
+  // Сброс предделителя (setTimerToHalfTick()): следующий отсчет через полный период.
+  if (address == native_hal::addr::kGTCCR) {
+    runTimer2(now_cycles);
+    timer2_next_count = now_cycles + timer2Prescaler();
+    return;
+  }
+  if (address == native_hal::addr::kTCNT2) {
+    runTimer2(now_cycles);
+    return;
+  }
+  if (address == native_hal::addr::kOCR2A) {
+    now_cycles += kCyclesPerPeriodUpdate;
+    runTimer2(now_cycles);
+    return;
+  }
+  if (address == native_hal::addr::kTIFR2) {
+    syncTimer2();
+  }
+#endif
+}
+
+// ----- Сверка кадров -----
+
+static boolean sameFrame(const LinFrame& a, const LinFrame& b) {
+  if (a.num_bytes() != b.num_bytes()) {
+    return false;
+  }
+  for (uint8 i = 0; i < a.num_bytes(); i++) {
+    if (a.get_byte(i) != b.get_byte(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Итог сверки. Кадры с помехой (ExpectedFrame::noisy) считаются отдельно: их
+// искажение или потеря допустимы.
+struct CheckResult {
+  uint32 decoded;
+  uint32 matched;
+  // Совпали байты кадра без помехи, но статус другой (для журнала - статус,
+  // который дает validate() байтам записи, иначе kStatusOk).
+  uint32 invalid;
+  uint32 lost;
+  // В окне метки времени ожидаемого кадра, но с другими байтами.
+  uint32 corrupted;
+  uint32 noisy;
+  uint32 noisy_lost;
+  uint32 noisy_corrupted;
+  // Кадры без ожидаемого кадра рядом (например, из импульса помехи).
+  uint32 spurious;
+  // Наибольшее отклонение метки времени кадра от начала байта синхронизации.
+  uint16 max_timestamp_error;
+};
+
+// Сверяет кадры декодера с ожидаемыми по метке времени: ожидаемый кадр, раньше
+// которого вышел более поздний кадр, потерян, а кадр с другими байтами искажен, но
+// не сдвигает сверку следующих.
+class FrameChecker {
+public:
+  FrameChecker(std::deque<traffic::ExpectedFrame>& expected, uint32 tolerance_ticks)
+    : expected_(expected), tolerance_ticks_(tolerance_ticks), last_ticks_(0), result_() {}
+
+  void check(const LinFrame& frame) {
+    result_.decoded++;
+    // Метка 16-битная: кадры выходят по порядку и не реже раза в 0,26 с, поэтому
+    // время восстанавливается по предыдущему кадру.
+    last_ticks_ += uint16(frame.timestamp_ticks() - uint16(last_ticks_));
+    while (!expected_.empty() && last_ticks_ > expected_.front().sync_cycle / 64 + tolerance_ticks_) {
+      popLost();
+    }
+    if (expected_.empty() || last_ticks_ + tolerance_ticks_ < expected_.front().sync_cycle / 64) {
+      result_.spurious++;
+      return;
+    }
+    const traffic::ExpectedFrame& expected = expected_.front();
+    if (!sameFrame(expected.frame, frame)) {
+      result_.noisy_corrupted += expected.noisy;
+      result_.corrupted += !expected.noisy;
+    } else {
+      result_.matched++;
+      result_.invalid += frame.status() != expected.frame.status() && !expected.noisy;
+      const int16 timestamp_error = int16(frame.timestamp_ticks() - expected.frame.timestamp_ticks());
+      const uint16 abs_error = timestamp_error < 0 ? -timestamp_error : timestamp_error;
+      result_.max_timestamp_error = abs_error > result_.max_timestamp_error ? abs_error : result_.max_timestamp_error;
+    }
+    result_.noisy += expected.noisy;
+    expected_.pop_front();
+  }
+
+  // Оставшиеся ожидаемые кадры потеряны.
+  const CheckResult& finish() {
+    while (!expected_.empty()) {
+      popLost();
+    }
+    return result_;
+  }
+
+private:
+  void popLost() {
+    const boolean noisy = expected_.front().noisy;
+    result_.noisy += noisy;
+    result_.noisy_lost += noisy;
+    result_.lost += !noisy;
+    expected_.pop_front();
+  }
+
+  std::deque<traffic::ExpectedFrame>& expected_;
+  const uint32 tolerance_ticks_;
+  // Метка последнего кадра в тиках с начала сигнала.
+  uint64_t last_ticks_;
+  CheckResult result_;
+};
+
+// ----- Вывод к хосту -----
+
+// Модель основного цикла, который выводит кадры через sio: кадр уходит из очереди
+// приема, только когда его строка помещается в выходной буфер (sio::kQueueTXSize),
+// а буфер освобождается со скоростью custom_defs::kHostBaud. Так видно переполнение
+// очереди приема (errors::BUFFER_OVERRUN) при полной загрузке шины. По умолчанию
+// модели нет и кадры забираются сразу.
+namespace host_outputs {
+static const uint8 NONE = 0;
+static const uint8 ASCII = 1;
+static const uint8 BINARY = 2;
+}
+
+static uint8 host_output = host_outputs::NONE;
+// Такт, когда выходной буфер опустеет.
+static uint64_t host_free_cycle;
+
+const double kCyclesPerHostByte = 10.0 * kCpuHz / custom_defs::kHostBaud;
+
+// Байты кадра в выводе sio с метками времени (Z1).
+static double hostBytes(const LinFrame& frame) {
+  if (host_output == host_outputs::ASCII) {
+    // "t", PID, пробел и DLC, данные и сумма, метка времени, CR.
+    return 1 + 2 + (frame.num_bytes() > 1 ? 2 : 0) + 2 * (frame.num_bytes() - 1) + 4 + 1;
+  }
+  // Байт количества, метка времени, байты кадра и доля заголовка и CRC записи: под
+  // нагрузкой в записи до 4 кадров.
+  return 1 + 4 + frame.num_bytes() + 5.0 / 4;
+}
+
+// Забрать готовые кадры из очереди приема. all - не ждать выходной буфер (конец
+// сигнала).
+static void drainFrames(FrameChecker& checker, boolean all) {
+  while (lin_processor::frameAvailable()) {
+    const LinFrame& frame = lin_processor::peekFrame();
+    if (host_output != host_outputs::NONE) {
+      const uint64_t start = host_free_cycle > now_cycles ? host_free_cycle : now_cycles;
+      const double bytes = hostBytes(frame);
+      if (!all && (start - now_cycles) / kCyclesPerHostByte + bytes > sio::kQueueTXSize - 1) {
+        return;
+      }
+      host_free_cycle = start + uint64_t(bytes * kCyclesPerHostByte);
+    }
+    checker.check(frame);
+    lin_processor::commitFrame();
+  }
+}
+
+// ----- Статистика путей ISR -----
+
+struct PathStats {
+  uint32 calls;
+  double total_ns;
+  double max_ns;
+  uint64_t total_wait_cycles;
+  uint32 max_wait_cycles;
+};
+
+// Векторы прерываний, которые вызывает стенд.
+namespace vectors {
+static const uint8 kTimer2CompA = 0;
+static const uint8 kInt0 = 1;
+static const uint8 kTimer1CompA = 2;
+static const uint8 kCount = 3;
+}
+
+const char* const kVectorNames[vectors::kCount] = { "T2 COMPA", "INT0", "T1 COMPA" };
+
+// [вектор][вид участка][0 - без цикла ожидания, 1 - с циклом ожидания]. ISR ждал в
+// цикле, если внутри него прошло больше бита модельного времени.
+static PathStats path_stats[vectors::kCount][kinds::kCount][2];
+
+// Наибольшее отклонение выборки Timer2 от середины бита (старт, данные, стоп), в
+// долях бита.
+static double max_sample_offset;
+// Наибольший уход выборок байта относительно выборки его стартового бита, в долях
+// бита. Показывает ошибку периода бита без ошибки поиска стартового фронта.
+static double max_sample_drift;
+static double start_bit_offset;
+
+// Учесть выборку бита в такте cycle.
+static void recordSample(uint64_t cycle) {
+  const uint8 kind = waveform->at(cycle).kind;
+  if (kind != kinds::START_BIT && kind != kinds::DATA_BIT && kind != kinds::STOP_BIT) {
+    return;
+  }
+  const double offset = waveform->offsetFromCenter(cycle);
+  max_sample_offset = fabs(offset) > max_sample_offset ? fabs(offset) : max_sample_offset;
+  if (kind == kinds::START_BIT) {
+    start_bit_offset = offset;
+  } else {
+    const double drift = fabs(offset - start_bit_offset);
+    max_sample_drift = drift > max_sample_drift ? drift : max_sample_drift;
+  }
+}
+
+typedef std::chrono::steady_clock Clock;
+
+// Вызвать обработчик прерывания в модельный момент now_cycles и учесть его стоимость.
+static void runIsr(void (*isr)(void), uint8 vector, Waveform& wave) {
+  const uint8 kind = wave.at(now_cycles).kind;
+  const uint64_t cycles_before = now_cycles;
+  // Тики в ожидании фронта (INT0 разрешен) только проверяют тайм-аут и не
+  // выбирают бит.
+  const boolean waiting_edge = native_hal::io[native_hal::addr::kEIMSK] & H(INT0);
+  if (vector == vectors::kTimer2CompA && !waiting_edge) {
+    recordSample(now_cycles);
+  }
+  const Clock::time_point isr_start = Clock::now();
+  isr();
+  const double ns = std::chrono::duration<double, std::nano>(Clock::now() - isr_start).count();
+#if !LIN_RX_EDGE_DECODER
+  if (vector == vectors::kTimer2CompA) {
+    now_cycles += kTimer2IsrCycles;
+    if (!waiting_edge && kind == kinds::STOP_BIT) {
+      now_cycles += kByteDoneCycles;
+    }
+    // Тайм-аут ожидания фронта: кадр закончен (или отброшен).
+    if (waiting_edge && !(native_hal::io[native_hal::addr::kEIMSK] & H(INT0))) {
+      now_cycles += kFrameDoneCycles;
+    }
+  }
+#endif
+
+  const uint32 wait_cycles = uint32(now_cycles - cycles_before);
+  PathStats& stats = path_stats[vector][kind][wait_cycles > wave.cyclesPerBit() ? 1 : 0];
+  stats.calls++;
+  stats.total_ns += ns;
+  stats.max_ns = ns > stats.max_ns ? ns : stats.max_ns;
+  stats.total_wait_cycles += wait_cycles;
+  stats.max_wait_cycles = wait_cycles > stats.max_wait_cycles ? wait_cycles : stats.max_wait_cycles;
+}
+
+// Основной цикл прошивки между прерываниями. Обращения к регистрам не продвигают
+// модельное время, иначе сдвинулась бы модель Timer2.
+static void runMainLoop() {
+  *reinterpret_cast<volatile uint16_t*>(&native_hal::io[native_hal::addr::kTCNT1]) = uint16(now_cycles / 64);
+  native_hal::access_hook = nullptr;
+  system_clock::loop();
+  lin_processor::loop();
+  native_hal::access_hook = accessHook;
+}
+
+// Задержка входа в ISR после события, такты CPU.
+const uint32 kIsrLatencyCycles = 32;
+
+#if LIN_RX_EDGE_DECODER
+// Такт CPU ближайшего совпадения Timer1 A или UINT64_MAX, если оно запрещено.
+static uint64_t nextTimer1CompareCycle() {
+  if (!(native_hal::io[native_hal::addr::kTIMSK1] & H(OCIE1A))) {
+    return UINT64_MAX;
+  }
+  const uint64_t ticks = now_cycles / 64;
+  const uint16 target = *reinterpret_cast<volatile uint16_t*>(&native_hal::io[native_hal::addr::kOCR1A]);
+  uint32 delta = uint16(target - uint16(ticks));
+  if (!delta) {
+    delta = 0x10000;
+  }
+  return (ticks + delta) * 64;
+}
+#endif
+
+}  // пространство имен
+
+static int usage() {
+  fprintf(stderr,
+          "usage: program [-g bits] [-k bits] [-j bits] [-d bits] [-r bits] [-i bits] [-n rate] [-w bits]\n"
+          "               [-s schedule | -c capture.log] [-o ascii|binary] [frames] [seed] [baud] [autobaud]\n");
+  return 2;
+}
+
+// Пауза, по которой декодер находит конец кадра (kMaxSpaceBits в lin_processor.cpp).
+const double kFrameEndSpaceBits = 6;
+
+// Пауза перед кадром из журнала не длиннее: помещается в 16-битные метки времени
+// сверки и не тратит время стенда на простой шины.
+const double kMaxReplaySpaceSeconds = 0.05;
+
+int main(int argc, char** argv) {
+  traffic::Options options;
+  const char* schedule_path = nullptr;
+  const char* capture_path = nullptr;
+  int opt;
+  while ((opt = getopt(argc, argv, "g:k:j:d:r:i:n:w:s:c:o:")) != -1) {
+    switch (opt) {
+      case 'g':
+        options.frame_space_bits = atof(optarg);
+        break;
+      case 'k':
+        options.break_bits = atof(optarg);
+        break;
+      case 'j':
+        options.break_jitter_bits = atof(optarg);
+        break;
+      case 'd':
+        options.delimiter_bits = atof(optarg);
+        break;
+      case 'r':
+        options.response_space_bits = atof(optarg);
+        break;
+      case 'i':
+        options.byte_space_bits = atof(optarg);
+        break;
+      case 'n':
+        options.glitches_per_bit = atof(optarg);
+        break;
+      case 'w':
+        options.glitch_bits = atof(optarg);
+        break;
+      case 's':
+        schedule_path = optarg;
+        break;
+      case 'c':
+        capture_path = optarg;
+        break;
+      case 'o':
+        if (!strcmp(optarg, "ascii")) {
+          host_output = host_outputs::ASCII;
+        } else if (!strcmp(optarg, "binary")) {
+          host_output = host_outputs::BINARY;
+        } else {
+          return usage();
+        }
+        break;
+      default:
+        return usage();
+    }
+  }
+  argc -= optind - 1;
+  argv += optind - 1;
+  uint32 num_frames = argc > 1 ? strtoul(argv[1], nullptr, 0) : 20000;
+  const uint32 seed = argc > 2 ? strtoul(argv[2], nullptr, 0) : 1;
+  const uint32 bus_baud = argc > 3 ? strtoul(argv[3], nullptr, 0) : custom_defs::kLinSpeed;
+  const uint8 autobaud_mode = argc > 4 ? uint8(strtoul(argv[4], nullptr, 0)) : lin_processor::autobaud_modes::OFF;
+
+  std::vector<traffic::ScheduleEntry> schedule;
+  if (schedule_path && !traffic::loadSchedule(schedule_path, &schedule)) {
+    return 2;
+  }
+  std::vector<traffic::CapturedFrame> captured;
+  if (capture_path) {
+    if (!traffic::loadCapture(capture_path, num_frames, &captured)) {
+      return 2;
+    }
+    num_frames = captured.size();
+  }
+
+  std::mt19937 rng(seed);
+  Waveform wave(bus_baud);
+  traffic::Generator generator(wave, options, rng);
+  std::deque<traffic::ExpectedFrame> expected;
+  boolean previous_glitched = false;
+  for (uint32 i = 0; i < num_frames; i++) {
+    traffic::ExpectedFrame frame;
+    double space_bits = options.frame_space_bits;
+    if (capture_path) {
+      frame.frame = captured[i].frame;
+      // В журнале только байты: ожидаемый статус (сумма, четность PID) - по ним же.
+      frame.frame.validate();
+      // Паузы журнала: время от начала прошлого кадра за вычетом его длины.
+      if (i > 0) {
+        const double seconds = double(captured[i].time_us - captured[i - 1].time_us) / 1e6;
+        const double bits = (seconds < kMaxReplaySpaceSeconds ? seconds : kMaxReplaySpaceSeconds) * bus_baud;
+        const double previous_bits = (wave.endCycle() - expected.back().sync_cycle) / wave.cyclesPerBit();
+        space_bits = bits - previous_bits > space_bits ? bits - previous_bits : space_bits;
+      }
+    } else if (!schedule.empty()) {
+      const traffic::ScheduleEntry& entry = schedule[i % schedule.size()];
+      uint8 data[8];
+      for (uint8 j = 0; j < entry.data_size; j++) {
+        data[j] = uint8(rng());
+      }
+      frame.frame = traffic::makeFrame(entry.id, data, entry.data_size);
+    } else {
+      frame.frame = traffic::randomFrame(rng);
+    }
+    // Перед первым кадром шина в покое.
+    generator.append(frame, i ? space_bits : space_bits + 20);
+    const boolean glitched = frame.noisy;
+    if (!expected.empty()) {
+      if (frame.noisy_space) {
+        expected.back().noisy = true;
+      }
+      // Без паузы конца кадра декодер, сбитый помехой, может пропустить разрыв.
+      if (previous_glitched && space_bits < kFrameEndSpaceBits) {
+        frame.noisy = true;
+      }
+    }
+    previous_glitched = glitched;
+    expected.push_back(frame);
+  }
+  // Декодер заканчивает последний кадр по паузе.
+  wave.appendBits(1, kinds::IDLE, 20);
+  if (autobaud_mode != lin_processor::autobaud_modes::OFF) {
+    expected.pop_front();
+  }
+  const uint32 num_expected = expected.size();
+  const double bus_seconds = double(wave.endCycle()) / kCpuHz;
+
+  waveform = &wave;
+  now_cycles = 0;
+  native_hal::access_hook = accessHook;
+  // RX в покое высокий.
+  native_hal::io[native_hal::addr::kPIND] |= kRxPinMask;
+  hardware_clock::setup();
+  lin_processor::setup();
+  if (autobaud_mode != lin_processor::autobaud_modes::OFF) {
+    lin_processor::setAutobaudMode(autobaud_mode);
+  } else {
+    lin_processor::setBaud(bus_baud);
+  }
+
+  // Окно сверки - 8 битов: меньше самого короткого кадра, больше ошибки метки.
+  FrameChecker checker(expected, 8 * (kCpuHz / 64) / bus_baud + 1);
+
+  const Clock::time_point start = Clock::now();
+
+#if LIN_RX_EDGE_DECODER
+  const char* const decoder_name = "edge (INT0 + Timer1)";
+  uint64_t edge_cycle = wave.nextEdge(0);
+  for (;;) {
+    // Следующее событие: фронт RX (INT0) или совпадение Timer1 A.
+    const uint64_t compare_cycle = nextTimer1CompareCycle();
+    const uint64_t event_cycle = edge_cycle < compare_cycle ? edge_cycle : compare_cycle;
+    if (event_cycle >= wave.endCycle()) {
+      break;
+    }
+    now_cycles = (event_cycle > now_cycles ? event_cycle : now_cycles) + kIsrLatencyCycles;
+    if (edge_cycle <= compare_cycle) {
+      runIsr(INT0_vect, vectors::kInt0, wave);
+      edge_cycle = wave.nextEdge(edge_cycle);
+    } else {
+      runIsr(TIMER1_COMPA_vect, vectors::kTimer1CompA, wave);
+    }
+#else
+  const char* const decoder_name = "sampler (Timer2)";
+  timer2_top = native_hal::io[native_hal::addr::kOCR2A];
+  timer2_next_count = now_cycles + timer2Prescaler();
+  while (now_cycles < wave.endCycle()) {
+    syncTimer2();
+    syncInt0();
+    const boolean int0_enabled = native_hal::io[native_hal::addr::kEIMSK] & H(INT0);
+    const boolean timer2_enabled = native_hal::io[native_hal::addr::kTIMSK2] & H(OCIE2A);
+    const uint64_t edge_cycle = int0_enabled ? pendingInt0Edge() : UINT64_MAX;
+    // Совпадение Timer2 вызывает ISR, если нет ожидающего INT0 (его приоритет выше).
+    // Вход задерживают прерывание UART и пролог.
+    if (timer2_enabled && timer2_match && edge_cycle > now_cycles) {
+      timer2_match = false;
+      now_cycles += kUartIsrCycles + kIsrLatencyCycles;
+      runTimer2(now_cycles);
+      runIsr(TIMER2_COMPA_vect, vectors::kTimer2CompA, wave);
+    } else if (edge_cycle <= timer2_next_count || !timer2_enabled) {
+      // Фронт RX раньше следующего отсчета Timer2 (или во время прошлого ISR)
+      // вызывает INT0. Вход в ISR сбрасывает флаг.
+      if (edge_cycle == UINT64_MAX) {
+        break;
+      }
+      const uint32 latency = kUartIsrCycles + kIsrLatencyCycles;
+      if (edge_cycle + latency > now_cycles) {
+        now_cycles = edge_cycle + latency;
+      }
+      runTimer2(now_cycles);
+      int0_from_cycle = now_cycles;
+      runIsr(INT0_vect, vectors::kInt0, wave);
+    } else {
+      // Один отсчет Timer2.
+      now_cycles = timer2_next_count;
+      runTimer2(now_cycles);
+      continue;
+    }
+#endif
+
+    if (autobaud_mode != lin_processor::autobaud_modes::OFF) {
+      runMainLoop();
+    }
+
+    // Основной цикл прошивки: забрать готовые кадры.
+    drainFrames(checker, false);
+  }
+  drainFrames(checker, true);
+
+  const double wall_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  const CheckResult& result = checker.finish();
+  const uint8 error_flags = lin_processor::getAndClearErrorFlags();
+
+  uint32 isr_calls = 0;
+  for (uint8 vector = 0; vector < vectors::kCount; vector++) {
+    for (uint8 kind = 0; kind < kinds::kCount; kind++) {
+      isr_calls += path_stats[vector][kind][0].calls + path_stats[vector][kind][1].calls;
+    }
+  }
+
+  static const char* const kSourceNames[] = { "random", "schedule", "capture" };
+  static const char* const kHostOutputNames[] = { "none", "ascii", "binary", };
+  static const char* const kErrorNames[8] = {
+    "too short", "too long", "start bit", "stop bit", "sync", "overrun", "other", "bit error",
+  };
+  printf("LIN decoder bench: %s, %u baud, %u frames, seed %u\n", decoder_name, bus_baud, num_frames, seed);
+  printf("  decoder baud    : %u (autobaud mode %u)\n", lin_processor::baud(), autobaud_mode);
+  printf("  traffic         : %s, space %.1f, break %.1f+-%.1f, response space %.1f, byte space %.1f bits\n",
+         kSourceNames[capture_path ? 2 : (schedule.empty() ? 0 : 1)], options.frame_space_bits, options.break_bits,
+         options.break_jitter_bits, options.response_space_bits, options.byte_space_bits);
+  printf("  noise           : %u glitches of %.2f bit\n", wave.glitches(), options.glitch_bits);
+  printf("  host output     : %s\n", kHostOutputNames[host_output]);
+  printf("  bus time        : %.3f s (load %.1f%%, %.0f frames/s)\n", bus_seconds,
+         100 * generator.frameBits() * wave.cyclesPerBit() / wave.endCycle(), num_frames / bus_seconds);
+  printf("  host time       : %.3f s\n", wall_seconds);
+  printf("  decoded         : %u (matched %u, invalid %u, lost %u, corrupted %u, spurious %u)\n", result.decoded,
+         result.matched, result.invalid, result.lost, result.corrupted, result.spurious);
+  printf("  noisy frames    : %u (lost %u, corrupted %u)\n", result.noisy, result.noisy_lost,
+         result.noisy_corrupted);
+  printf("  frames/s (bus)  : %.0f decoded\n", result.decoded / bus_seconds);
+  printf("  frames/s (host) : %.0f\n", result.decoded / wall_seconds);
+  printf("  ISR calls/frame : %.1f\n", double(isr_calls) / num_frames);
+  printf("  timestamp error : %u ticks max\n", result.max_timestamp_error);
+#if !LIN_RX_EDGE_DECODER
+  printf("  sample offset   : %.2f%% of bit max (drift within byte %.2f%%)\n", 100 * max_sample_offset,
+         100 * max_sample_drift);
+#endif
+  printf("  error flags     : 0x%02x\n", error_flags);
+  printf("  error counts    :");
+  for (uint8 i = 0; i < 8; i++) {
+    printf(" %s %u%s", kErrorNames[i], stats::stats_private::error_counts[i], i < 7 ? "," : "\n");
+  }
+  printf("  frame queue max : %u of %u bytes\n", stats::stats_private::frame_queue_max,
+         lin_processor::kFrameRingSize);
+  printf("\n  %-36s %10s %10s %10s %12s %12s\n", "ISR path", "calls", "avg ns", "max ns", "avg wait cy", "max wait cy");
+  for (uint8 vector = 0; vector < vectors::kCount; vector++) {
+    for (uint8 kind = 0; kind < kinds::kCount; kind++) {
+      for (uint8 waited = 0; waited < 2; waited++) {
+        const PathStats& stats = path_stats[vector][kind][waited];
+        if (!stats.calls) {
+          continue;
+        }
+        char name[48];
+        snprintf(name, sizeof(name), "%s: %s%s", kVectorNames[vector], kKindNames[kind], waited ? " + wait" : "");
+        printf("  %-36s %10u %10.1f %10.1f %12.1f %12u\n", name, stats.calls, stats.total_ns / stats.calls,
+               stats.max_ns, double(stats.total_wait_cycles) / stats.calls, stats.max_wait_cycles);
+      }
+    }
+  }
+
+  // Без помех каждый кадр должен совпасть; с помехами - каждый кадр без помехи.
+  const uint32 clean = num_expected - result.noisy;
+  const boolean passed = result.matched - (result.noisy - result.noisy_lost - result.noisy_corrupted) == clean &&
+                         !result.invalid && (wave.glitches() || !result.spurious);
+  return passed ? 0 : 1;
+}
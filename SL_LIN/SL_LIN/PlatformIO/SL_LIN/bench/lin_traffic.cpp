@@ -0,0 +1,198 @@
+#include "lin_traffic.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "capture_log.h"
+
+namespace traffic {
+
+const char* const kKindNames[kinds::kCount] = {
+  "idle", "break", "break delimiter", "start bit", "data bit", "stop bit", "noise",
+};
+
+// ----- Waveform -----
+
+void Waveform::appendBits(uint8 level, uint8 kind, double bits) {
+  const double end = end_cycle_ + bits * cycles_per_bit_;
+  appendSegment(level, kind, end_cycle_);
+  if (noise_rng_) {
+    // Не больше одной помехи на бит, целиком внутри участка.
+    std::uniform_real_distribution<double> uniform(0, 1);
+    for (double bit = 0; bit + glitch_bits_ < bits; bit++) {
+      if (uniform(*noise_rng_) >= glitches_per_bit_) {
+        continue;
+      }
+      const double room = (bits - bit < 1 ? bits - bit : 1) - glitch_bits_;
+      const double start = end_cycle_ + (bit + uniform(*noise_rng_) * room) * cycles_per_bit_;
+      appendSegment(!level, kinds::NOISE, start);
+      appendSegment(level, kind, start + glitch_bits_ * cycles_per_bit_);
+      glitches_++;
+    }
+  }
+  end_cycle_ = end;
+}
+
+double Waveform::offsetFromCenter(uint64_t cycle) {
+  at(cycle);
+  if (cursor_ + 1 >= segments_.size()) {
+    return 0;
+  }
+  const double center = 0.5 * (segments_[cursor_].start_cycle + segments_[cursor_ + 1].start_cycle);
+  return (double(cycle) - center) / cycles_per_bit_;
+}
+
+uint64_t Waveform::nextEdge(uint64_t cycle) {
+  const uint8 level = at(cycle).level;
+  for (size_t i = cursor_ + 1; i < segments_.size(); i++) {
+    if (segments_[i].level != level) {
+      return segments_[i].start_cycle;
+    }
+  }
+  return UINT64_MAX;
+}
+
+uint64_t Waveform::nextEdgeTo(uint64_t cycle, uint8 level) {
+  uint8 previous = at(cycle).level;
+  for (size_t i = cursor_ + 1; i < segments_.size(); i++) {
+    if (segments_[i].level != previous) {
+      if (segments_[i].level == level) {
+        return segments_[i].start_cycle;
+      }
+      previous = segments_[i].level;
+    }
+  }
+  return UINT64_MAX;
+}
+
+// ----- Generator -----
+
+void Generator::append(ExpectedFrame& expected, double space_bits) {
+  LinFrame& frame = expected.frame;
+  const uint32 glitches_before = wave_.glitches();
+  if (space_bits > 0) {
+    wave_.appendBits(1, kinds::IDLE, space_bits);
+  }
+  expected.noisy_space = wave_.glitches() != glitches_before;
+  const uint64_t frame_start = wave_.endCycle();
+  double break_bits = options_.break_bits;
+  if (options_.break_jitter_bits > 0) {
+    std::uniform_real_distribution<double> jitter(-options_.break_jitter_bits, options_.break_jitter_bits);
+    break_bits += jitter(rng_);
+  }
+  wave_.appendBits(0, kinds::BREAK, break_bits);
+  wave_.appendBits(1, kinds::DELIMITER, options_.delimiter_bits);
+  expected.sync_cycle = wave_.endCycle();
+  frame.set_timestamp_ticks(uint16(expected.sync_cycle / 64));
+  wave_.appendByte(0x55);
+  wave_.appendByte(frame.get_byte(0));
+  if (frame.num_bytes() > 1) {
+    if (options_.response_space_bits > 0) {
+      wave_.appendBits(1, kinds::IDLE, options_.response_space_bits);
+    }
+    for (uint8 i = 1; i < frame.num_bytes(); i++) {
+      if (i > 1 && options_.byte_space_bits > 0) {
+        wave_.appendBits(1, kinds::IDLE, options_.byte_space_bits);
+      }
+      wave_.appendByte(frame.get_byte(i));
+    }
+  }
+  frame_bits_ += (wave_.endCycle() - frame_start) / wave_.cyclesPerBit();
+  expected.noisy = wave_.glitches() != glitches_before;
+}
+
+// ----- Источники кадров -----
+
+LinFrame makeFrame(uint8 id, const uint8* data, uint8 data_size) {
+  LinFrame frame;
+  frame.append_byte(lin_ids::protectedId(id));
+  if (data_size == 0) {
+    return frame;
+  }
+  for (uint8 i = 0; i < data_size; i++) {
+    frame.append_byte(data[i]);
+  }
+  // computeChecksum() не учитывает последний байт, поэтому добавляем
+  // заполнитель и затем собираем кадр заново с настоящей суммой.
+  frame.append_byte(0);
+  const boolean enhanced = (id & 3) != 3 && id != 0x3c && id != 0x3d;
+  const uint8 checksum = frame.computeChecksum(enhanced);
+  LinFrame result;
+  for (uint8 i = 0; i + 1 < frame.num_bytes(); i++) {
+    result.append_byte(frame.get_byte(i));
+  }
+  result.append_byte(checksum);
+  return result;
+}
+
+LinFrame randomFrame(std::mt19937& rng) {
+  static const uint8 kDataSizes[] = { 0, 1, 2, 4, 8 };
+  const uint8 id = rng() & 0x3f;
+  const uint8 data_size = kDataSizes[rng() % ARRAY_SIZE(kDataSizes)];
+  uint8 data[8];
+  for (uint8 i = 0; i < data_size; i++) {
+    data[i] = uint8(rng());
+  }
+  return makeFrame(id, data, data_size);
+}
+
+bool loadSchedule(const char* path, std::vector<ScheduleEntry>* schedule) {
+  FILE* file = fopen(path, "r");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  char line[256];
+  uint32 line_number = 0;
+  while (fgets(line, sizeof(line), file)) {
+    line_number++;
+    // Остаток длинной строки - продолжение комментария.
+    if (!strchr(line, '\n')) {
+      int c;
+      while ((c = fgetc(file)) != EOF && c != '\n') {
+      }
+    }
+    const char* text = line + strspn(line, " \t\r\n");
+    if (!*text || *text == '#') {
+      continue;
+    }
+    unsigned id;
+    unsigned data_size;
+    char rest;
+    if (sscanf(text, "%x %u %c", &id, &data_size, &rest) != 2 || id > 0x3f || data_size > 8) {
+      fprintf(stderr, "%s:%u: expected \"ID DATA_SIZE\"\n", path, line_number);
+      fclose(file);
+      return false;
+    }
+    schedule->push_back({ uint8(id), uint8(data_size) });
+  }
+  fclose(file);
+  if (schedule->empty()) {
+    fprintf(stderr, "%s: empty schedule\n", path);
+    return false;
+  }
+  return true;
+}
+
+bool loadCapture(const char* path, uint32 max_frames, std::vector<CapturedFrame>* frames) {
+  capture_log::Reader log;
+  if (!log.open(path)) {
+    return false;
+  }
+  for (uint64_t n = 0; n < log.count() && frames->size() < max_frames; n++) {
+    const capture_log::Record& record = log.record(n);
+    if (record.info & (capture_log::kInfoSummary | capture_log::kInfoStatus)) {
+      continue;
+    }
+    CapturedFrame captured;
+    for (uint8 i = 0; i < record.numBytes(); i++) {
+      captured.frame.append_byte(record.bytes[i]);
+    }
+    captured.time_us = record.time_us;
+    frames->push_back(captured);
+  }
+  return true;
+}
+
+}  // пространство имен traffic
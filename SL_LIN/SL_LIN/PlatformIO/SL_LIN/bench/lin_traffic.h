@@ -0,0 +1,211 @@
+#ifndef LIN_TRAFFIC_H
+#define LIN_TRAFFIC_H
+
+#include <stdint.h>
+
+#include <random>
+#include <vector>
+
+#include "avr_util.h"
+#include "lin_frame.h"
+
+// Синтетический трафик шины LIN для стенда декодера (lin_bench.cpp): сигнал RX с
+// точностью до такта CPU из последовательности кадров. Кадры - случайные, по
+// таблице расписания (loadSchedule()) или из журнала lin_capture (loadCapture()).
+// Паузы, длина разрыва и ее разброс задаются Options; помехи - короткие импульсы
+// противоположного уровня в случайных битах.
+namespace traffic {
+
+const uint32 kCpuHz = 16000000;
+
+// Что передается на шине в данный момент. Используется для классификации путей ISR.
+namespace kinds {
+static const uint8 IDLE = 0;
+static const uint8 BREAK = 1;
+static const uint8 DELIMITER = 2;
+static const uint8 START_BIT = 3;
+static const uint8 DATA_BIT = 4;
+static const uint8 STOP_BIT = 5;
+// Импульс помехи.
+static const uint8 NOISE = 6;
+static const uint8 kCount = 7;
+}
+
+extern const char* const kKindNames[kinds::kCount];
+
+// Участок сигнала постоянного уровня.
+struct Segment {
+  uint64_t start_cycle;
+  uint8 level;
+  uint8 kind;
+};
+
+// Сигнал RX как последовательность участков. Чтение идет от курсора, поэтому
+// быстрое для почти неубывающего времени; назад курсор отходит на несколько
+// участков (фронт INT0 во время ISR).
+class Waveform {
+public:
+  explicit Waveform(uint32 baud)
+    : cycles_per_bit_(double(kCpuHz) / baud),
+      end_cycle_(0),
+      cursor_(0),
+      noise_rng_(nullptr),
+      glitches_per_bit_(0),
+      glitch_bits_(0),
+      glitches_(0) {}
+
+  // Помехи в следующих appendBits(): в каждом бите с вероятностью glitches_per_bit
+  // импульс противоположного уровня длиной glitch_bits бита.
+  void setNoise(std::mt19937* rng, double glitches_per_bit, double glitch_bits) {
+    noise_rng_ = glitches_per_bit > 0 ? rng : nullptr;
+    glitches_per_bit_ = glitches_per_bit;
+    glitch_bits_ = glitch_bits;
+  }
+
+  void appendBits(uint8 level, uint8 kind, double bits);
+
+  // Стартовый бит, 8 бит данных (младший первым), стоповый бит.
+  void appendByte(uint8 value) {
+    appendBits(0, kinds::START_BIT, 1);
+    for (uint8 i = 0; i < 8; i++) {
+      appendBits((value >> i) & 1, kinds::DATA_BIT, 1);
+    }
+    appendBits(1, kinds::STOP_BIT, 1);
+  }
+
+  uint64_t endCycle() const {
+    return uint64_t(end_cycle_);
+  }
+
+  double cyclesPerBit() const {
+    return cycles_per_bit_;
+  }
+
+  // Сколько импульсов помех добавлено.
+  uint32 glitches() const {
+    return glitches_;
+  }
+
+  const Segment& at(uint64_t cycle) {
+    while (cursor_ > 0 && segments_[cursor_].start_cycle > cycle) {
+      cursor_--;
+    }
+    while (cursor_ + 1 < segments_.size() && segments_[cursor_ + 1].start_cycle <= cycle) {
+      cursor_++;
+    }
+    return segments_[cursor_];
+  }
+
+  // Отклонение cycle от середины текущего участка в долях бита. Для участков
+  // длиной в один бит - ошибка момента выборки.
+  double offsetFromCenter(uint64_t cycle);
+
+  // Такт ближайшего изменения уровня после cycle или UINT64_MAX.
+  uint64_t nextEdge(uint64_t cycle);
+
+  // Такт ближайшего перехода на уровень level после cycle или UINT64_MAX.
+  uint64_t nextEdgeTo(uint64_t cycle, uint8 level);
+
+private:
+  void appendSegment(uint8 level, uint8 kind, double start) {
+    segments_.push_back({ uint64_t(start + 0.5), level, kind });
+  }
+
+  const double cycles_per_bit_;
+  double end_cycle_;
+  std::vector<Segment> segments_;
+  size_t cursor_;
+
+  std::mt19937* noise_rng_;
+  double glitches_per_bit_;
+  double glitch_bits_;
+  uint32 glitches_;
+};
+
+// Форма кадров на шине, в битах.
+struct Options {
+  // Пауза перед разрывом. Декодер находит конец кадра по паузе дольше
+  // kMaxSpaceBits (lin_processor.cpp); 0 - кадры вплотную.
+  double frame_space_bits = 10;
+  double break_bits = 13;
+  // Длина разрыва равномерно в break_bits +- break_jitter_bits.
+  double break_jitter_bits = 0;
+  double delimiter_bits = 1;
+  // Пауза между заголовком и ответом подчиненного устройства.
+  double response_space_bits = 1;
+  // Пауза между байтами ответа.
+  double byte_space_bits = 0;
+  // Помехи, см. Waveform::setNoise().
+  double glitches_per_bit = 0;
+  double glitch_bits = 0.1;
+};
+
+// Кадр, который должен выйти из декодера.
+struct ExpectedFrame {
+  LinFrame frame;
+  // Начало байта синхронизации в тактах CPU. frame.timestamp_ticks() - младшие 16
+  // бит того же времени в тиках hardware_clock.
+  uint64_t sync_cycle;
+  // В кадре или в паузе перед ним есть помеха: искажение или потеря допустимы.
+  boolean noisy;
+  // Помеха в паузе перед кадром. Если она ближе kMaxSpaceBits к концу предыдущего
+  // кадра, декодер читает ее как стартовый бит и теряет тот кадр.
+  boolean noisy_space;
+};
+
+// Добавляет кадры в сигнал по Options.
+class Generator {
+public:
+  Generator(Waveform& wave, const Options& options, std::mt19937& rng)
+    : wave_(wave), options_(options), rng_(rng), frame_bits_(0) {
+    wave_.setNoise(&rng_, options_.glitches_per_bit, options_.glitch_bits);
+  }
+
+  // Добавить expected.frame после паузы space_bits. Записывает ожидаемую метку
+  // времени кадра - начало байта синхронизации - и признаки помехи.
+  void append(ExpectedFrame& expected, double space_bits);
+
+  // Биты, занятые кадрами (без пауз перед ними): загрузка шины - их доля.
+  double frameBits() const {
+    return frame_bits_;
+  }
+
+private:
+  Waveform& wave_;
+  const Options options_;
+  std::mt19937& rng_;
+  double frame_bits_;
+};
+
+// Кадр ID id с данными data и контрольной суммой. Каждый четвертый ID - узел
+// LIN 1.x с классической суммой, диагностические ID всегда с классической.
+// data_size 0 - только заголовок.
+extern LinFrame makeFrame(uint8 id, const uint8* data, uint8 data_size);
+
+// Кадр со случайными ID, длиной (0, 1, 2, 4 или 8 байтов) и данными.
+extern LinFrame randomFrame(std::mt19937& rng);
+
+// Строка таблицы расписания: ID и длина данных, данные случайные.
+struct ScheduleEntry {
+  uint8 id;
+  uint8 data_size;
+};
+
+// Прочитать расписание: по строке "ID ДЛИНА" (ID в hex, длина 0..8), "#" -
+// комментарий. Кадры идут по кругу.
+extern bool loadSchedule(const char* path, std::vector<ScheduleEntry>* schedule);
+
+// Кадр журнала lin_capture.
+struct CapturedFrame {
+  LinFrame frame;
+  uint64_t time_us;
+};
+
+// Прочитать не больше max_frames правильных кадров журнала lin_capture (см.
+// host/capture_log.h). Кадры с ошибкой и сводки пропускаются; кадры, переданные
+// самим SL_LIN, тоже были на шине и остаются.
+extern bool loadCapture(const char* path, uint32 max_frames, std::vector<CapturedFrame>* frames);
+
+}  // пространство имен traffic
+
+#endif
@@ -0,0 +1,76 @@
+#!/bin/sh
+# Регрессия пропускной способности декодера: сценарии трафика на стенде lin_bench.
+#
+#   pio run -e native && bench/traffic_suite.sh [program] [журнал lin_capture]
+#
+# program по умолчанию .pio/build/native/program (для декодера по фронтам -
+# .pio/build/native_edge/program). С журналом добавляется воспроизведение записанного
+# трафика. Сценарии "gate" должны пройти (код возврата стенда 0), сценарии "report"
+# только печатаются: это известные пределы. Сценарии выше 20000 бод - для сборки с
+# LIN_RX_HIGH_SPEED, остальные сборки их пропускают. Итог - код возврата 1, если не
+# прошел хотя бы один сценарий "gate".
+
+cd "$(dirname "$0")/.." || exit 2
+PROGRAM=${1:-.pio/build/native/program}
+CAPTURE=$2
+FRAMES=${FRAMES:-2000}
+SEED=${SEED:-1}
+
+failed=0
+
+# run gate|report имя бод опции...
+run() {
+  kind=$1
+  name=$2
+  baud=$3
+  shift 3
+  output=$("$PROGRAM" "$@" "$FRAMES" "$SEED" "$baud" 2>&1)
+  code=$?
+  # Скорость выше lin_processor::kMaxBaud сборки (декодер по фронтам - до
+  # kMaxSampledBaud) декодер не принимает.
+  if [ "$(echo "$output" | sed -n 's/^ *decoder baud *: \([0-9]*\).*/\1/p')" != "$baud" ]; then
+    printf '%-6s %-4s %-28s %6s  not supported by this build\n' "$kind" skip "$name" "$baud"
+    return
+  fi
+  if [ $code -eq 0 ]; then
+    result=ok
+  elif [ "$kind" = gate ]; then
+    result=FAIL
+    failed=1
+  else
+    result=fail
+  fi
+  decoded=$(echo "$output" | sed -n 's/^ *decoded *: //p')
+  rate=$(echo "$output" | sed -n 's/^ *frames\/s (bus) *: \([0-9]*\).*/\1/p')
+  overruns=$(echo "$output" | sed -n 's/.*overrun \([0-9]*\).*/\1/p')
+  printf '%-6s %-4s %-28s %6s  %4s fr/s  overrun %-4s %s\n' "$kind" "$result" "$name" "$baud" \
+    "$rate" "$overruns" "$decoded"
+  if [ $code -ne 0 ] && [ $code -ne 1 ]; then
+    echo "$output"
+  fi
+}
+
+run gate default 19200
+run gate "min spaces" 19200 -g 7 -r 0
+run gate back-to-back 19200 -g 0 -r 0
+run gate "byte spaces" 19200 -r 4 -i 2
+run gate "break 11" 19200 -k 11
+run gate "break 16+-3" 19200 -k 16 -j 3
+run gate "delimiter 4" 19200 -d 4
+run gate "noise 0.001" 19200 -n 0.001
+run gate "noise 0.003, 0.3 bit" 19200 -n 0.003 -w 0.3
+run gate schedule 19200 -s bench/traffic_schedule.txt
+run gate "back-to-back, ascii out" 19200 -g 0 -r 0 -o ascii
+run gate "back-to-back, binary out" 19200 -g 0 -r 0 -o binary
+run gate default 25000
+run gate back-to-back 25000 -g 0 -r 0
+run gate "noise 0.001" 25000 -n 0.001
+run gate "byte spaces" 25000 -r 4 -i 2
+run gate "break 11" 25000 -k 11
+run gate "back-to-back, ascii out" 25000 -g 0 -r 0 -o ascii
+run gate "back-to-back, binary out" 25000 -g 0 -r 0 -o binary
+if [ -n "$CAPTURE" ]; then
+  run gate "replay $(basename "$CAPTURE")" 19200 -c "$CAPTURE"
+fi
+
+exit $failed
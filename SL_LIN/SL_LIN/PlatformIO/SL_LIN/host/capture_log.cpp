@@ -0,0 +1,339 @@
+#include "capture_log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+namespace capture_log {
+
+namespace {
+
+// Заголовок обоих файлов. Остаток kHeaderSize - нули.
+struct FileHeader {
+  char magic[8];
+  uint32_t version;
+  // Размер Record или IndexEntry.
+  uint32_t item_size;
+  // Записей журнала (в индексе - записей журнала, учтенных в индексе). Пишется
+  // последним, читается первым.
+  uint64_t count;
+};
+
+const char kLogMagic[8] = { 'S', 'L', 'L', 'I', 'N', 'L', 'O', 'G' };
+const char kIndexMagic[8] = { 'S', 'L', 'L', 'I', 'N', 'I', 'D', 'X' };
+const uint32_t kVersion = 1;
+
+FileHeader* header(const MappedFile& file) {
+  return reinterpret_cast<FileHeader*>(file.data());
+}
+
+uint64_t loadCount(const MappedFile& file) {
+  return __atomic_load_n(&header(file)->count, __ATOMIC_ACQUIRE);
+}
+
+void storeCount(const MappedFile& file, uint64_t count) {
+  __atomic_store_n(&header(file)->count, count, __ATOMIC_RELEASE);
+}
+
+// Файл начинается с заголовка magic с размером элемента item_size.
+bool validHeader(const MappedFile& file, const char* magic, uint32_t item_size) {
+  if (file.size() < kHeaderSize) {
+    return false;
+  }
+  const FileHeader* h = header(file);
+  return !memcmp(h->magic, magic, sizeof(h->magic)) && h->version == kVersion && h->item_size == item_size;
+}
+
+// Записать заголовок нового файла.
+void initHeader(const MappedFile& file, const char* magic, uint32_t item_size) {
+  memset(file.data(), 0, kHeaderSize);
+  FileHeader* h = header(file);
+  memcpy(h->magic, magic, sizeof(h->magic));
+  h->version = kVersion;
+  h->item_size = item_size;
+}
+
+// Сколько элементов размера item_size помещается в файле.
+uint64_t capacity(const MappedFile& file, uint32_t item_size) {
+  return file.size() < kHeaderSize ? 0 : (file.size() - kHeaderSize) / item_size;
+}
+
+std::string indexPath(const char* path) {
+  return std::string(path) + ".idx";
+}
+
+}  // namespace
+
+// ----- MappedFile -----
+
+bool MappedFile::open(const char* path, bool writable) {
+  close();
+  fd_ = ::open(path, writable ? (O_RDWR | O_CREAT) : O_RDONLY, 0644);
+  if (fd_ < 0) {
+    return false;
+  }
+  writable_ = writable;
+  struct stat st;
+  if (fstat(fd_, &st)) {
+    close();
+    return false;
+  }
+  return map(st.st_size);
+}
+
+void MappedFile::close() {
+  if (data_) {
+    munmap(data_, size_);
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+  }
+  fd_ = -1;
+  data_ = nullptr;
+  size_ = 0;
+}
+
+bool MappedFile::map(size_t size) {
+  if (data_) {
+    munmap(data_, size_);
+    data_ = nullptr;
+  }
+  size_ = size;
+  if (!size) {
+    return true;
+  }
+  void* data = mmap(nullptr, size, writable_ ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd_, 0);
+  if (data == MAP_FAILED) {
+    size_ = 0;
+    return false;
+  }
+  data_ = static_cast<uint8_t*>(data);
+  return true;
+}
+
+bool MappedFile::grow(size_t size) {
+  if (size <= size_) {
+    return true;
+  }
+  if (ftruncate(fd_, size)) {
+    return false;
+  }
+  return map(size);
+}
+
+bool MappedFile::refresh() {
+  struct stat st;
+  if (fstat(fd_, &st)) {
+    return false;
+  }
+  return size_t(st.st_size) == size_ || map(st.st_size);
+}
+
+// ----- Writer -----
+
+Record* Writer::records() const {
+  return reinterpret_cast<Record*>(log_.data() + kHeaderSize);
+}
+
+IndexEntry* Writer::entries() const {
+  return reinterpret_cast<IndexEntry*>(index_.data() + kHeaderSize);
+}
+
+bool Writer::open(const char* path) {
+  if (!log_.open(path, true)) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+  if (!log_.size()) {
+    if (!log_.grow(kHeaderSize + size_t(kGrowRecords) * sizeof(Record))) {
+      fprintf(stderr, "%s: %s\n", path, strerror(errno));
+      return false;
+    }
+    initHeader(log_, kLogMagic, sizeof(Record));
+  } else if (!validHeader(log_, kLogMagic, sizeof(Record))) {
+    fprintf(stderr, "%s: not a capture log\n", path);
+    return false;
+  }
+  count_ = std::min(loadCount(log_), capacity(log_, sizeof(Record)));
+  last_time_us_ = count_ ? records()[count_ - 1].time_us : 0;
+
+  // Индекс - производные данные: непригодный файл строится заново.
+  const std::string index_path = indexPath(path);
+  if (!index_.open(index_path.c_str(), true)) {
+    fprintf(stderr, "%s: %s\n", index_path.c_str(), strerror(errno));
+    return false;
+  }
+  uint64_t indexed = 0;
+  if (validHeader(index_, kIndexMagic, sizeof(IndexEntry))) {
+    indexed = std::min(loadCount(index_), count_);
+    indexed = std::min(indexed, capacity(index_, sizeof(IndexEntry)) * kRecordsPerBlock);
+  } else {
+    if (!index_.grow(kHeaderSize)) {
+      fprintf(stderr, "%s: %s\n", index_path.c_str(), strerror(errno));
+      return false;
+    }
+    initHeader(index_, kIndexMagic, sizeof(IndexEntry));
+  }
+  // Неполный последний блок пересчитывается целиком.
+  for (uint64_t n = indexed / kRecordsPerBlock * kRecordsPerBlock; n < count_; n++) {
+    if (!indexRecord(n, records()[n])) {
+      fprintf(stderr, "%s: %s\n", index_path.c_str(), strerror(errno));
+      return false;
+    }
+  }
+  commit();
+  return true;
+}
+
+bool Writer::indexRecord(uint64_t n, const Record& record) {
+  const uint64_t block = n / kRecordsPerBlock;
+  if (block >= capacity(index_, sizeof(IndexEntry))) {
+    const uint64_t blocks = block + kGrowRecords / kRecordsPerBlock;
+    if (!index_.grow(kHeaderSize + blocks * sizeof(IndexEntry))) {
+      return false;
+    }
+  }
+  IndexEntry& entry = entries()[block];
+  const uint16_t offset = uint16_t(n % kRecordsPerBlock);
+  if (!offset) {
+    entry.first_time_us = record.time_us;
+    entry.id_mask = 0;
+  }
+  entry.last_time_us = record.time_us;
+  const uint64_t id_bit = uint64_t(1) << record.id();
+  if (!(entry.id_mask & id_bit)) {
+    entry.first[record.id()] = offset;
+  }
+  entry.last[record.id()] = offset;
+  entry.id_mask |= id_bit;
+  return true;
+}
+
+bool Writer::append(Record record) {
+  if (count_ >= capacity(log_, sizeof(Record))) {
+    if (!log_.grow(kHeaderSize + (count_ + kGrowRecords) * sizeof(Record))) {
+      fprintf(stderr, "capture log: %s\n", strerror(errno));
+      return false;
+    }
+  }
+  record.time_us = std::max(record.time_us, last_time_us_);
+  records()[count_] = record;
+  if (!indexRecord(count_, record)) {
+    fprintf(stderr, "capture log index: %s\n", strerror(errno));
+    return false;
+  }
+  count_++;
+  last_time_us_ = record.time_us;
+  return true;
+}
+
+void Writer::commit() {
+  // Сначала журнал: индекс не может учитывать записи, которых Reader не увидит.
+  storeCount(log_, count_);
+  storeCount(index_, count_);
+}
+
+// ----- Reader -----
+
+bool Reader::open(const char* path) {
+  if (!log_.open(path, false)) {
+    fprintf(stderr, "%s: %s\n", path, strerror(errno));
+    return false;
+  }
+  if (!validHeader(log_, kLogMagic, sizeof(Record))) {
+    fprintf(stderr, "%s: not a capture log\n", path);
+    return false;
+  }
+  // Без индекса запросы работают просмотром всего журнала.
+  const std::string index_path = indexPath(path);
+  if (!index_.open(index_path.c_str(), false) || !validHeader(index_, kIndexMagic, sizeof(IndexEntry))) {
+    fprintf(stderr, "%s: no index, queries scan the whole log (rebuilt by the next capture)\n",
+            index_path.c_str());
+    index_.close();
+  }
+  return refresh();
+}
+
+bool Reader::refresh() {
+  // Индекс первым: он учитывает не больше записей, чем уже видно в журнале.
+  uint64_t indexed = 0;
+  if (index_.data()) {
+    if (!index_.refresh()) {
+      return false;
+    }
+    indexed = std::min(loadCount(index_), capacity(index_, sizeof(IndexEntry)) * kRecordsPerBlock);
+  }
+  if (!log_.refresh()) {
+    return false;
+  }
+  count_ = std::min(loadCount(log_), capacity(log_, sizeof(Record)));
+  indexed_ = std::min(indexed, count_);
+  return true;
+}
+
+const Record& Reader::record(uint64_t n) const {
+  return reinterpret_cast<const Record*>(log_.data() + kHeaderSize)[n];
+}
+
+uint64_t Reader::query(int id, uint64_t from_us, uint64_t to_us,
+                       const std::function<bool(const Record&)>& visit) const {
+  const Record* const records = reinterpret_cast<const Record*>(log_.data() + kHeaderSize);
+  const IndexEntry* const entries = reinterpret_cast<const IndexEntry*>(index_.data() + kHeaderSize);
+  const uint64_t id_mask = id < 0 ? ~uint64_t(0) : uint64_t(1) << id;
+  const auto before = [](const Record& record, uint64_t time_us) { return record.time_us < time_us; };
+  uint64_t scanned = 0;
+
+  // Просмотреть записи [begin, end), начиная с первой не раньше from_us. false -
+  // дальше смотреть не нужно.
+  const auto scan = [&](uint64_t begin, uint64_t end) {
+    const Record* record = std::lower_bound(records + begin, records + end, from_us, before);
+    for (; record != records + end; record++) {
+      scanned++;
+      if (record->time_us > to_us) {
+        return false;
+      }
+      if ((id_mask >> record->id()) & 1) {
+        if (!visit(*record)) {
+          return false;
+        }
+      }
+    }
+    return true;
+  };
+
+  // Первый блок, который кончается не раньше from_us.
+  const uint64_t blocks = (indexed_ + kRecordsPerBlock - 1) / kRecordsPerBlock;
+  uint64_t block = std::partition_point(entries, entries + blocks, [&](const IndexEntry& entry) {
+                     return entry.last_time_us < from_us;
+                   }) - entries;
+  for (; block < blocks; block++) {
+    const IndexEntry& entry = entries[block];
+    if (entry.first_time_us > to_us) {
+      return scanned;
+    }
+    if (!(entry.id_mask & id_mask)) {
+      continue;
+    }
+    uint64_t begin = block * kRecordsPerBlock;
+    uint64_t end = std::min(begin + kRecordsPerBlock, indexed_);
+    if (id >= 0) {
+      end = std::min(begin + entry.last[id] + 1, end);
+      begin += entry.first[id];
+    }
+    if (!scan(begin, end)) {
+      return scanned;
+    }
+  }
+  // Записи за индексом.
+  scan(indexed_, count_);
+  return scanned;
+}
+
+}  // пространство имен capture_log
@@ -0,0 +1,186 @@
+#ifndef CAPTURE_LOG_H
+#define CAPTURE_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+
+// Журнал кадров LIN на хосте (lin_capture). Два файла, оба отображаются в память:
+//
+//   <путь>      - заголовок kHeaderSize байтов, затем записи Record подряд. Записи
+//                 фиксированного размера, поэтому запись n находится по смещению без
+//                 чтения предыдущих. Файл растет кусками kGrowRecords записей, число
+//                 записей хранится в заголовке и увеличивается после записи кадра.
+//   <путь>.idx  - разреженный индекс: на каждые kRecordsPerBlock записей одна
+//                 IndexEntry с временем первой и последней записи блока, маской ID,
+//                 встречающихся в блоке, и первой и последней записью каждого ID.
+//
+// Время записей не убывает (см. Writer::append()), поэтому запрос по ID и времени -
+// двоичный поиск первого блока по времени, затем в каждом блоке, в маске которого
+// есть ID, просмотр записей от первой до последней записи ID. Редкий ID читает по
+// одной записи на блок. Индекс - чуть больше 1% журнала.
+//
+// Читать журнал можно во время записи: Reader видит записи, число которых уже
+// записано в заголовок, остаток за индексом просматривается без индекса.
+namespace capture_log {
+
+// Размер блока индекса в записях.
+static const uint32_t kRecordsPerBlock = 1024;
+
+// Шаг увеличения файла журнала.
+static const uint32_t kGrowRecords = 1u << 20;
+
+static const uint32_t kHeaderSize = 4096;
+
+// Биты Record::info. Совпадают с байтом количества в двоичной записи sio.cpp.
+static const uint8_t kInfoCountMask = 0x0f;
+static const uint8_t kInfoStatus = 0x10;
+static const uint8_t kInfoTx = 0x20;
+// Сводка повторов режима изменений: bytes[0] - PID, bytes[1] - число повторов.
+static const uint8_t kInfoSummary = 0x40;
+
+// Кадр в журнале.
+struct Record {
+  // Время начала байта синхронизации, микросекунды Unix.
+  uint64_t time_us;
+  // Номер кадра в сеансе устройства (SEQ двоичного вывода, расширенный до 32 бит).
+  uint32_t seq;
+  // Количество байтов и флаги kInfo*.
+  uint8_t info;
+  // LinFrame::status(), если установлен kInfoStatus, иначе 0.
+  uint8_t status;
+  // PID, данные, контрольная сумма, как в LinFrame.
+  uint8_t bytes[10];
+
+  uint8_t id() const {
+    return bytes[0] & 0x3f;
+  }
+
+  uint8_t numBytes() const {
+    return info & kInfoCountMask;
+  }
+};
+
+static_assert(sizeof(Record) == 24, "Record is a file format");
+
+// Элемент индекса: блок записей [n * kRecordsPerBlock, (n + 1) * kRecordsPerBlock).
+struct IndexEntry {
+  uint64_t first_time_us;
+  uint64_t last_time_us;
+  // Бит i - в блоке есть запись с ID i.
+  uint64_t id_mask;
+  // Номера в блоке первой и последней записи каждого ID из id_mask.
+  uint16_t first[64];
+  uint16_t last[64];
+};
+
+static_assert(sizeof(IndexEntry) == 280, "IndexEntry is a file format");
+
+// Отображенный в память файл. Общий для Writer и Reader.
+class MappedFile {
+public:
+  MappedFile() : fd_(-1), data_(nullptr), size_(0), writable_(false) {}
+  ~MappedFile() {
+    close();
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Открыть файл. writable - создать, если нет, и отображать для записи.
+  bool open(const char* path, bool writable);
+  void close();
+
+  // Увеличить файл до size байтов (не меньше текущего) и отобразить заново.
+  bool grow(size_t size);
+
+  // Отобразить заново, если файл вырос (чтение во время записи).
+  bool refresh();
+
+  uint8_t* data() const {
+    return data_;
+  }
+
+  size_t size() const {
+    return size_;
+  }
+
+private:
+  bool map(size_t size);
+
+  int fd_;
+  uint8_t* data_;
+  size_t size_;
+  bool writable_;
+};
+
+// Добавление записей. Один писатель на журнал.
+class Writer {
+public:
+  // Открыть или создать журнал. Если индекс не покрывает все записи (писатель был
+  // прерван, файл индекса удален), он достраивается по журналу.
+  bool open(const char* path);
+
+  // Добавить запись. Время меньше времени последней записи заменяется им: время
+  // журнала не убывает.
+  bool append(Record record);
+
+  // Записать число записей в заголовок: после этого записи видны Reader.
+  void commit();
+
+  uint64_t count() const {
+    return count_;
+  }
+
+  uint64_t lastTimeUs() const {
+    return last_time_us_;
+  }
+
+private:
+  Record* records() const;
+  IndexEntry* entries() const;
+  bool indexRecord(uint64_t n, const Record& record);
+
+  MappedFile log_;
+  MappedFile index_;
+  uint64_t count_ = 0;
+  uint64_t last_time_us_ = 0;
+};
+
+// Запросы к журналу.
+class Reader {
+public:
+  bool open(const char* path);
+
+  // Перечитать число записей (журнал пишется). false - ошибка отображения.
+  bool refresh();
+
+  uint64_t count() const {
+    return count_;
+  }
+
+  // Записей, учтенных в индексе (0 - индекса нет).
+  uint64_t indexedCount() const {
+    return indexed_;
+  }
+
+  const Record& record(uint64_t n) const;
+
+  // Вызвать visit для каждой записи с ID id (или любым при id < 0) и временем в
+  // [from_us, to_us] по возрастанию времени. visit возвращает false, чтобы
+  // прекратить. Возвращает число просмотренных записей.
+  uint64_t query(int id, uint64_t from_us, uint64_t to_us,
+                 const std::function<bool(const Record&)>& visit) const;
+
+private:
+  MappedFile log_;
+  MappedFile index_;
+  uint64_t count_ = 0;
+  // Записей, учтенных в индексе. Последний блок индекса может быть неполным.
+  uint64_t indexed_ = 0;
+};
+
+}  // пространство имен capture_log
+
+#endif
@@ -0,0 +1,357 @@
+// Запись трафика SL_LIN в журнал с индексом и запросы к нему. Собирается в
+// [env:capture] (платформа native, Linux):
+//
+//   pio run -e capture
+//   .pio/build/capture/program capture [-b бод] [-x команда]... ПОРТ ЖУРНАЛ
+//   .pio/build/capture/program query [-i ID] [-f с] [-t по] [-c] ЖУРНАЛ
+//   .pio/build/capture/program info ЖУРНАЛ
+//
+// capture открывает последовательный порт SL_LIN (подойдет и псевдотерминал),
+// включает метки времени и двоичный вывод (C, Z1, B1, команды -x, например -x S5 или
+// -x G1, затем O) и дописывает кадры в журнал (capture_log.h), пока не получит
+// SIGINT/SIGTERM. Вместо порта можно указать файл с записанным выводом устройства
+// или "-" (stdin): тогда команды не посылаются и запись идет до конца файла.
+// Раз в kStatusPeriodSeconds и в конце печатает счетчики в stderr.
+//
+// query печатает кадры ID (hex, 0..3F) со временем в [с, по] - секунды Unix с
+// дробной частью, по умолчанию весь журнал. -c - только число кадров. Журнал можно
+// читать во время записи.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "capture_log.h"
+#include "record_stream.h"
+
+namespace {
+
+const uint32_t kDefaultHostBaud = 115200;  // custom_defs::kHostBaud
+const uint32_t kStatusPeriodSeconds = 10;
+
+volatile sig_atomic_t stop_requested = 0;
+
+void requestStop(int) {
+  stop_requested = 1;
+}
+
+uint64_t unixTimeUs() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+           std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int usage() {
+  fprintf(stderr,
+          "usage: lin_capture capture [-b baud] [-x command]... PORT|FILE|- LOG\n"
+          "       lin_capture query [-i ID] [-f from] [-t to] [-c] LOG\n"
+          "       lin_capture info LOG\n");
+  return 2;
+}
+
+bool speedFor(uint32_t baud, speed_t* speed) {
+  static const struct {
+    uint32_t baud;
+    speed_t speed;
+  } kSpeeds[] = {
+    { 9600, B9600 },     { 19200, B19200 },     { 38400, B38400 },     { 57600, B57600 },
+    { 115200, B115200 }, { 230400, B230400 },   { 460800, B460800 },   { 500000, B500000 },
+    { 921600, B921600 }, { 1000000, B1000000 }, { 2000000, B2000000 },
+  };
+  for (const auto& entry : kSpeeds) {
+    if (entry.baud == baud) {
+      *speed = entry.speed;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Перевести терминал в двоичный режим 8N1 без управления потоком.
+bool configurePort(int fd, uint32_t baud) {
+  speed_t speed;
+  if (!speedFor(baud, &speed)) {
+    fprintf(stderr, "unsupported host baud %u\n", baud);
+    return false;
+  }
+  struct termios tio;
+  if (tcgetattr(fd, &tio)) {
+    perror("tcgetattr");
+    return false;
+  }
+  cfmakeraw(&tio);
+  tio.c_cflag |= CLOCAL | CREAD;
+  tio.c_cflag &= ~CRTSCTS;
+  tio.c_cc[VMIN] = 0;
+  tio.c_cc[VTIME] = 0;
+  cfsetispeed(&tio, speed);
+  cfsetospeed(&tio, speed);
+  if (tcsetattr(fd, TCSANOW, &tio)) {
+    perror("tcsetattr");
+    return false;
+  }
+  tcflush(fd, TCIFLUSH);
+  return true;
+}
+
+bool sendCommand(int fd, const std::string& command) {
+  const std::string line = command + "\r";
+  if (write(fd, line.data(), line.size()) != ssize_t(line.size())) {
+    perror("write");
+    return false;
+  }
+  return true;
+}
+
+void printCounters(const RecordStream& stream, const capture_log::Writer& log) {
+  const RecordStream::Counters& counters = stream.counters();
+  fprintf(stderr, "records %llu, frames %llu, lost %llu, bad records %llu, log %llu frames\n",
+          (unsigned long long)counters.records, (unsigned long long)counters.frames,
+          (unsigned long long)counters.lost_frames, (unsigned long long)counters.bad_records,
+          (unsigned long long)log.count());
+}
+
+int capture(int argc, char** argv) {
+  uint32_t host_baud = kDefaultHostBaud;
+  std::vector<std::string> commands;
+  int opt;
+  while ((opt = getopt(argc, argv, "b:x:")) != -1) {
+    switch (opt) {
+    case 'b':
+      host_baud = strtoul(optarg, nullptr, 0);
+      break;
+    case 'x':
+      commands.push_back(optarg);
+      break;
+    default:
+      return usage();
+    }
+  }
+  if (argc - optind != 2) {
+    return usage();
+  }
+  const char* const port = argv[optind];
+  const char* const path = argv[optind + 1];
+
+  capture_log::Writer log;
+  if (!log.open(path)) {
+    return 1;
+  }
+
+  const int fd = strcmp(port, "-") ? open(port, O_RDWR | O_NOCTTY) : STDIN_FILENO;
+  if (fd < 0) {
+    fprintf(stderr, "%s: %s\n", port, strerror(errno));
+    return 1;
+  }
+  // Порт или псевдотерминал: настроить и включить двоичный вывод. Файл читается
+  // как есть.
+  const bool device = isatty(fd);
+  if (device) {
+    if (!configurePort(fd, host_baud)) {
+      return 1;
+    }
+    // CR сбрасывает недописанную команду в буфере устройства.
+    std::vector<std::string> init = { "", "C", "Z1", "B1" };
+    init.insert(init.end(), commands.begin(), commands.end());
+    init.push_back("O");
+    for (const std::string& command : init) {
+      if (!sendCommand(fd, command)) {
+        return 1;
+      }
+    }
+  }
+
+  RecordStream stream(
+    [&](const capture_log::Record& record) {
+      if (!log.append(record)) {
+        stop_requested = 1;
+      }
+    },
+    [](const char* line) { fprintf(stderr, "device: %s\n", line); });
+
+  signal(SIGINT, requestStop);
+  signal(SIGTERM, requestStop);
+
+  std::vector<uint8_t> buffer(64 * 1024);
+  uint64_t next_status_us = unixTimeUs() + kStatusPeriodSeconds * 1000000ull;
+  int result = 0;
+  while (!stop_requested) {
+    if (device) {
+      struct pollfd pfd = { fd, POLLIN, 0 };
+      if (poll(&pfd, 1, 1000) < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        perror("poll");
+        result = 1;
+        break;
+      }
+    }
+    const ssize_t n = read(fd, buffer.data(), buffer.size());
+    const uint64_t now_us = unixTimeUs();
+    if (n < 0) {
+      if (errno == EINTR || errno == EAGAIN) {
+        continue;
+      }
+      fprintf(stderr, "%s: %s\n", port, strerror(errno));
+      result = 1;
+      break;
+    }
+    if (n == 0 && !device) {
+      break;
+    }
+    stream.feed(buffer.data(), n, now_us);
+    log.commit();
+    if (now_us >= next_status_us) {
+      next_status_us = now_us + kStatusPeriodSeconds * 1000000ull;
+      printCounters(stream, log);
+    }
+  }
+  log.commit();
+  printCounters(stream, log);
+  return result;
+}
+
+// Время в секундах Unix с дробной частью в микросекундах.
+bool parseTime(const char* text, uint64_t* time_us) {
+  char* end;
+  const double seconds = strtod(text, &end);
+  if (*end || seconds < 0) {
+    return false;
+  }
+  *time_us = uint64_t(seconds * 1e6 + 0.5);
+  return true;
+}
+
+void printRecord(const capture_log::Record& record) {
+  char line[96];
+  int size = snprintf(line, sizeof(line), "%llu.%06llu ", (unsigned long long)(record.time_us / 1000000),
+                      (unsigned long long)(record.time_us % 1000000));
+  if (record.info & capture_log::kInfoSummary) {
+    // Как строка сводки ASCII: kPPRR.
+    size += snprintf(line + size, sizeof(line) - size, "k%02X%02X", record.bytes[0], record.bytes[1]);
+  } else {
+    // Как строка кадра ASCII: t (e - свой кадр), PID, DLC, данные и сумма; затем
+    // статус ошибки.
+    size += snprintf(line + size, sizeof(line) - size, "%c%02X", (record.info & capture_log::kInfoTx) ? 'e' : 't',
+                     record.bytes[0]);
+    const uint8_t num_bytes = record.numBytes();
+    if (num_bytes > 1) {
+      size += snprintf(line + size, sizeof(line) - size, " %u", num_bytes - 2);
+    }
+    for (uint8_t i = 1; i < num_bytes; i++) {
+      size += snprintf(line + size, sizeof(line) - size, "%02X", record.bytes[i]);
+    }
+    if (record.info & capture_log::kInfoStatus) {
+      size += snprintf(line + size, sizeof(line) - size, " status %u", record.status);
+    }
+  }
+  puts(line);
+}
+
+int query(int argc, char** argv) {
+  int id = -1;
+  uint64_t from_us = 0;
+  uint64_t to_us = UINT64_MAX;
+  bool count_only = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "i:f:t:c")) != -1) {
+    switch (opt) {
+    case 'i':
+      id = strtol(optarg, nullptr, 16);
+      if (id < 0 || id > 0x3f) {
+        return usage();
+      }
+      break;
+    case 'f':
+      if (!parseTime(optarg, &from_us)) {
+        return usage();
+      }
+      break;
+    case 't':
+      if (!parseTime(optarg, &to_us)) {
+        return usage();
+      }
+      break;
+    case 'c':
+      count_only = true;
+      break;
+    default:
+      return usage();
+    }
+  }
+  if (argc - optind != 1) {
+    return usage();
+  }
+  capture_log::Reader log;
+  if (!log.open(argv[optind])) {
+    return 1;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  uint64_t found = 0;
+  const uint64_t scanned = log.query(id, from_us, to_us, [&](const capture_log::Record& record) {
+    found++;
+    if (!count_only) {
+      printRecord(record);
+    }
+    return true;
+  });
+  const double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  if (count_only) {
+    printf("%llu\n", (unsigned long long)found);
+  }
+  fprintf(stderr, "%llu frames, %llu records scanned of %llu, %.3f ms\n", (unsigned long long)found,
+          (unsigned long long)scanned, (unsigned long long)log.count(), ms);
+  return 0;
+}
+
+int info(int argc, char** argv) {
+  if (argc != 2) {
+    return usage();
+  }
+  capture_log::Reader log;
+  if (!log.open(argv[1])) {
+    return 1;
+  }
+  printf("frames  : %llu\n", (unsigned long long)log.count());
+  printf("indexed : %llu (%llu records per block)\n", (unsigned long long)log.indexedCount(),
+         (unsigned long long)capture_log::kRecordsPerBlock);
+  if (log.count()) {
+    const uint64_t first_us = log.record(0).time_us;
+    const uint64_t last_us = log.record(log.count() - 1).time_us;
+    printf("from    : %llu.%06llu\n", (unsigned long long)(first_us / 1000000),
+           (unsigned long long)(first_us % 1000000));
+    printf("to      : %llu.%06llu\n", (unsigned long long)(last_us / 1000000),
+           (unsigned long long)(last_us % 1000000));
+  }
+  return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    return usage();
+  }
+  const std::string command = argv[1];
+  if (command == "capture") {
+    return capture(argc - 1, argv + 1);
+  }
+  if (command == "query") {
+    return query(argc - 1, argv + 1);
+  }
+  if (command == "info") {
+    return info(argc - 1, argv + 1);
+  }
+  return usage();
+}
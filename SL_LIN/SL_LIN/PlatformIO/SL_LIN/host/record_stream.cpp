@@ -0,0 +1,197 @@
+#include "record_stream.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace {
+
+// Константы двоичного вывода. Должны совпадать с sio.cpp.
+const uint8_t kRecordMarker = 0xA5;
+const uint8_t kRecordTimestampFlag = 0x80;
+const uint8_t kRecordSummaryFlag = 0x40;
+const uint8_t kRecordTxFlag = 0x20;
+const uint8_t kRecordStatusFlag = 0x10;
+const uint8_t kRecordEventMask = 0x0f;
+const uint8_t kRecordEventBaudLock = 0x01;
+const uint8_t kMaxFrameBytes = 10;
+const uint8_t kMaxRecordPayload = 4 * (1 + 4 + 1 + kMaxFrameBytes);
+
+// Маркер, N, SEQ (2) и CRC.
+const uint8_t kRecordOverhead = 5;
+
+// Длина строки ASCII, после которой она выводится без CR.
+const size_t kMaxLine = 256;
+
+const uint32_t kMicrosPerTick = 4;
+
+uint8_t crc8Update(uint8_t crc, uint8_t b) {
+  crc ^= b;
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = (crc & 0x80) ? uint8_t((crc << 1) ^ 0x07) : uint8_t(crc << 1);
+  }
+  return crc;
+}
+
+}  // namespace
+
+void RecordStream::restart() {
+  started_ = false;
+  anchored_ = false;
+}
+
+void RecordStream::feed(const uint8_t* data, size_t size, uint64_t host_time_us) {
+  buffer_.insert(buffer_.end(), data, data + size);
+  const size_t used = parse(0, host_time_us);
+  buffer_.erase(buffer_.begin(), buffer_.begin() + used);
+}
+
+size_t RecordStream::parse(size_t pos, uint64_t host_time_us) {
+  const uint8_t* const buffer = buffer_.data();
+  const size_t size = buffer_.size();
+  while (pos < size) {
+    if (buffer[pos] != kRecordMarker) {
+      // После искаженной записи байты до следующего маркера - ее остаток, не текст.
+      if (!resync_) {
+        text(buffer[pos]);
+      }
+      pos++;
+      continue;
+    }
+    if (size - pos < 2) {
+      return pos;
+    }
+    const uint8_t n = buffer[pos + 1];
+    if (!n || n > kMaxRecordPayload) {
+      // Не запись: маркер в мусоре на линии.
+      counters_.bad_records++;
+      resync_ = true;
+      pos++;
+      continue;
+    }
+    if (size - pos < size_t(n) + kRecordOverhead) {
+      return pos;
+    }
+    uint8_t crc = 0;
+    for (size_t i = pos + 1; i < pos + 4 + n; i++) {
+      crc = crc8Update(crc, buffer[i]);
+    }
+    const uint16_t seq = uint16_t(buffer[pos + 2] | (buffer[pos + 3] << 8));
+    if (crc != buffer[pos + 4 + n] || !decodeRecord(buffer + pos + 4, n, seq, host_time_us)) {
+      // Искаженная запись: поиск следующего маркера со следующего байта.
+      counters_.bad_records++;
+      resync_ = true;
+      pos++;
+      continue;
+    }
+    counters_.records++;
+    resync_ = false;
+    pos += n + kRecordOverhead;
+  }
+  return pos;
+}
+
+bool RecordStream::decodeRecord(const uint8_t* payload, uint8_t size, uint16_t seq, uint64_t host_time_us) {
+  // Сначала проверка структуры: запись с ошибкой не дает ни одного кадра.
+  for (uint8_t pos = 0; pos < size;) {
+    const uint8_t count = payload[pos];
+    if (count & kRecordSummaryFlag) {
+      pos += 3;
+    } else {
+      const uint8_t num_bytes = count & 0x0f;
+      if (!num_bytes || num_bytes > kMaxFrameBytes) {
+        return false;
+      }
+      pos += 1 + ((count & kRecordTimestampFlag) ? 4 : 0) + ((count & kRecordStatusFlag) ? 1 : 0) + num_bytes;
+    }
+    if (pos > size) {
+      return false;
+    }
+  }
+
+  // SEQ 16-битный; пропуск считается потерей кадров.
+  if (started_) {
+    const uint16_t gap = uint16_t(seq - uint16_t(next_seq_));
+    if (gap < 0x8000) {
+      counters_.lost_frames += gap;
+      next_seq_ += gap;
+    }
+  } else {
+    started_ = true;
+    next_seq_ = seq;
+  }
+
+  for (uint8_t pos = 0; pos < size;) {
+    capture_log::Record record;
+    memset(&record, 0, sizeof(record));
+    record.seq = next_seq_++;
+    const uint8_t count = payload[pos++];
+    if ((count & kRecordSummaryFlag) && (count & kRecordEventMask)) {
+      // Событие получает номер, но не кадр журнала. Захват скорости - той же
+      // строкой, что и в режиме ASCII.
+      if ((count & kRecordEventMask) == kRecordEventBaudLock) {
+        char line[16];
+        snprintf(line, sizeof(line), "a%u", unsigned(payload[pos] | (payload[pos + 1] << 8)));
+        text_sink_(line);
+      }
+      pos += 2;
+      continue;
+    }
+    if (count & kRecordSummaryFlag) {
+      record.info = capture_log::kInfoSummary | 2;
+      record.bytes[0] = payload[pos++];
+      record.bytes[1] = payload[pos++];
+      record.time_us = last_time_us_ ? last_time_us_ : host_time_us;
+    } else {
+      record.info = count & (0x0f | kRecordTxFlag | kRecordStatusFlag);
+      if (count & kRecordTimestampFlag) {
+        const uint32_t ticks = payload[pos] | (payload[pos + 1] << 8) | (payload[pos + 2] << 16) |
+                               (uint32_t(payload[pos + 3]) << 24);
+        pos += 4;
+        if (!anchored_) {
+          anchored_ = true;
+          last_ticks_ = ticks;
+          ticks_ = 0;
+          anchor_time_us_ = host_time_us;
+        }
+        record.time_us = frameTimeUs(ticks);
+      } else {
+        record.time_us = host_time_us;
+      }
+      if (count & kRecordStatusFlag) {
+        record.status = payload[pos++];
+      }
+      memcpy(record.bytes, payload + pos, count & 0x0f);
+      pos += count & 0x0f;
+      last_time_us_ = record.time_us;
+    }
+    counters_.frames++;
+    frame_sink_(record);
+  }
+  return true;
+}
+
+uint64_t RecordStream::frameTimeUs(uint32_t ticks) {
+  // Разность со знаком: кадры очереди устройства могут идти чуть не по порядку
+  // времени (свои переданные кадры).
+  ticks_ += int32_t(ticks - last_ticks_);
+  last_ticks_ = ticks;
+  const int64_t time_us = int64_t(anchor_time_us_) + ticks_ * kMicrosPerTick;
+  return time_us < 0 ? 0 : uint64_t(time_us);
+}
+
+void RecordStream::text(uint8_t b) {
+  if (b == '\r' || b == '\n' || line_.size() >= kMaxLine) {
+    if (!line_.empty()) {
+      line_.push_back('\0');
+      text_sink_(line_.data());
+      line_.clear();
+    }
+    return;
+  }
+  // BEL - команда отвергнута. Прочие непечатные байты - остатки искаженных записей.
+  if (b == 7) {
+    line_.push_back('!');
+  } else if (b >= 0x20 && b < 0x7f) {
+    line_.push_back(char(b));
+  }
+}
@@ -0,0 +1,80 @@
+#ifndef RECORD_STREAM_H
+#define RECORD_STREAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+#include "capture_log.h"
+
+// Разбор вывода SL_LIN в двоичном режиме (B1, формат записей см. sio.cpp) в записи
+// capture_log::Record. Байты вне записей - ответы на команды ASCII - собираются в
+// строки до CR. События записей передаются строками, как в режиме ASCII (захват
+// скорости - "a<бод>").
+//
+// Метка времени кадра (Z1) - 32 бита тиков 4 мкс, переполняется через 4,8 ч. Она
+// расширяется по разности с предыдущей и переводится во время Unix относительно
+// первого кадра сеанса: время хоста при его приеме плюс время устройства от него.
+// Часы устройства (кварц или резонатор Nano) не подстраиваются, за сутки время может
+// уйти на секунды-минуты. Кадр без метки (Z0) и сводка повторов получают время
+// хоста.
+class RecordStream {
+public:
+  struct Counters {
+    // Принятые записи с правильной CRC.
+    uint64_t records = 0;
+    // Кадры и сводки в них.
+    uint64_t frames = 0;
+    // Пропуски SEQ: записи, не поместившиеся в выходной буфер устройства или
+    // потерянные на линии.
+    uint64_t lost_frames = 0;
+    // Записи с неверной CRC или длиной и записи с нарушенной структурой.
+    uint64_t bad_records = 0;
+  };
+
+  typedef std::function<void(const capture_log::Record&)> FrameSink;
+  typedef std::function<void(const char* line)> TextSink;
+
+  RecordStream(FrameSink frame_sink, TextSink text_sink)
+    : frame_sink_(frame_sink), text_sink_(text_sink) {}
+
+  // Разобрать очередные байты. host_time_us - время их приема.
+  void feed(const uint8_t* data, size_t size, uint64_t host_time_us);
+
+  // Начать новый сеанс устройства (после B1 номера кадров и время начинаются
+  // заново).
+  void restart();
+
+  const Counters& counters() const {
+    return counters_;
+  }
+
+private:
+  // Разобрать буфер с позиции pos. Возвращает позицию первого неразобранного байта.
+  size_t parse(size_t pos, uint64_t host_time_us);
+  bool decodeRecord(const uint8_t* payload, uint8_t size, uint16_t seq, uint64_t host_time_us);
+  uint64_t frameTimeUs(uint32_t ticks);
+  void text(uint8_t b);
+
+  FrameSink frame_sink_;
+  TextSink text_sink_;
+  Counters counters_;
+
+  std::vector<uint8_t> buffer_;
+  std::vector<char> line_;
+  // Была искаженная запись, правильной после нее еще не было.
+  bool resync_ = false;
+
+  bool started_ = false;
+  uint32_t next_seq_ = 0;
+
+  bool anchored_ = false;
+  uint32_t last_ticks_ = 0;
+  int64_t ticks_ = 0;
+  uint64_t anchor_time_us_ = 0;
+  uint64_t last_time_us_ = 0;
+};
+
+#endif
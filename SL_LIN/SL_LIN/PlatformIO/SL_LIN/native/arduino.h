@@ -0,0 +1,33 @@
+#ifndef NATIVE_ARDUINO_H
+#define NATIVE_ARDUINO_H
+
+// Минимальная замена Arduino.h для сборки [env:native]. Содержит только то,
+// что используется в src/.
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "native_hal.h"
+
+#if !defined(F_CPU)
+#define F_CPU 16000000L
+#endif
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// Флеш-память на хосте - обычная память.
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+#define vsnprintf_P vsnprintf
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper*>(string_literal))
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+
+extern void delayMicroseconds(unsigned int us);
+
+#endif
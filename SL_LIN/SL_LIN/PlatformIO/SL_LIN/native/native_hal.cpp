@@ -0,0 +1,15 @@
+#include "native_hal.h"
+
+#include "arduino.h"
+
+namespace native_hal {
+alignas(2) volatile uint8_t io[0x100];
+AccessHook access_hook = nullptr;
+DelayHook delay_hook = nullptr;
+}  // пространство имен native_hal
+
+void delayMicroseconds(unsigned int us) {
+  if (native_hal::delay_hook) {
+    native_hal::delay_hook(us);
+  }
+}
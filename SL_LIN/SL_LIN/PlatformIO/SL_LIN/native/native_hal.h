@@ -0,0 +1,192 @@
+#ifndef NATIVE_HAL_H
+#define NATIVE_HAL_H
+
+#include <stdint.h>
+
+// Тонкий слой аппаратной абстракции для сборки [env:native].
+//
+// Регистры ATmega328p моделируются массивом памяти с теми же адресами, что и в
+// пространстве данных AVR, поэтому арифметика указателей в io_pins.h (DDRx и PINx
+// на один и два адреса ниже PORTx) работает без изменений. Каждое обращение к
+// регистру через макросы ниже вызывает необязательный хук, через который стенд
+// (bench/) обновляет динамические регистры (TCNT1, PIND и т.д.) из модельного времени.
+//
+// Прерывания не моделируются: cli()/sei() пустые, а обработчики ISR() становятся
+// обычными функциями с C-связыванием, которые стенд вызывает синхронно.
+namespace native_hal {
+
+// Адреса регистров в пространстве данных ATmega328p (см. iom328p.h).
+namespace addr {
+static const uint8_t kPINB = 0x23;
+static const uint8_t kDDRB = 0x24;
+static const uint8_t kPORTB = 0x25;
+static const uint8_t kPINC = 0x26;
+static const uint8_t kDDRC = 0x27;
+static const uint8_t kPORTC = 0x28;
+static const uint8_t kPIND = 0x29;
+static const uint8_t kDDRD = 0x2A;
+static const uint8_t kPORTD = 0x2B;
+static const uint8_t kTIFR1 = 0x36;
+static const uint8_t kTIFR2 = 0x37;
+static const uint8_t kEIFR = 0x3C;
+static const uint8_t kGTCCR = 0x43;
+static const uint8_t kEIMSK = 0x3D;
+static const uint8_t kEICRA = 0x69;
+static const uint8_t kTIMSK1 = 0x6F;
+static const uint8_t kTIMSK2 = 0x70;
+static const uint8_t kTCCR1A = 0x80;
+static const uint8_t kTCCR1B = 0x81;
+static const uint8_t kTCNT1 = 0x84;
+static const uint8_t kOCR1A = 0x88;
+static const uint8_t kOCR1B = 0x8A;
+static const uint8_t kTCCR2A = 0xB0;
+static const uint8_t kTCCR2B = 0xB1;
+static const uint8_t kTCNT2 = 0xB2;
+static const uint8_t kOCR2A = 0xB3;
+static const uint8_t kOCR2B = 0xB4;
+static const uint8_t kUCSR0A = 0xC0;
+static const uint8_t kUCSR0B = 0xC1;
+static const uint8_t kUCSR0C = 0xC2;
+static const uint8_t kUBRR0L = 0xC4;
+static const uint8_t kUBRR0H = 0xC5;
+static const uint8_t kUDR0 = 0xC6;
+}  // пространство имен addr
+
+// Память регистров. Выровнена для 16-битных регистров (little endian, как на AVR).
+extern volatile uint8_t io[0x100];
+
+// Вызывается перед каждым обращением к регистру с его адресом. nullptr - без хука.
+typedef void (*AccessHook)(uint8_t address);
+extern AccessHook access_hook;
+
+// Вызывается из delayMicroseconds(). nullptr - задержка игнорируется.
+typedef void (*DelayHook)(uint32_t micros);
+extern DelayHook delay_hook;
+
+inline volatile uint8_t* reg8(uint8_t address) {
+  if (access_hook) {
+    access_hook(address);
+  }
+  return &io[address];
+}
+
+inline volatile uint16_t* reg16(uint8_t address) {
+  if (access_hook) {
+    access_hook(address);
+  }
+  return reinterpret_cast<volatile uint16_t*>(&io[address]);
+}
+
+}  // пространство имен native_hal
+
+#define PINB (*native_hal::reg8(native_hal::addr::kPINB))
+#define DDRB (*native_hal::reg8(native_hal::addr::kDDRB))
+#define PORTB (*native_hal::reg8(native_hal::addr::kPORTB))
+#define PINC (*native_hal::reg8(native_hal::addr::kPINC))
+#define DDRC (*native_hal::reg8(native_hal::addr::kDDRC))
+#define PORTC (*native_hal::reg8(native_hal::addr::kPORTC))
+#define PIND (*native_hal::reg8(native_hal::addr::kPIND))
+#define DDRD (*native_hal::reg8(native_hal::addr::kDDRD))
+#define PORTD (*native_hal::reg8(native_hal::addr::kPORTD))
+#define TIFR1 (*native_hal::reg8(native_hal::addr::kTIFR1))
+#define TIFR2 (*native_hal::reg8(native_hal::addr::kTIFR2))
+#define EIFR (*native_hal::reg8(native_hal::addr::kEIFR))
+#define GTCCR (*native_hal::reg8(native_hal::addr::kGTCCR))
+#define EIMSK (*native_hal::reg8(native_hal::addr::kEIMSK))
+#define EICRA (*native_hal::reg8(native_hal::addr::kEICRA))
+#define TIMSK1 (*native_hal::reg8(native_hal::addr::kTIMSK1))
+#define TIMSK2 (*native_hal::reg8(native_hal::addr::kTIMSK2))
+#define TCCR1A (*native_hal::reg8(native_hal::addr::kTCCR1A))
+#define TCCR1B (*native_hal::reg8(native_hal::addr::kTCCR1B))
+#define TCNT1 (*native_hal::reg16(native_hal::addr::kTCNT1))
+#define OCR1A (*native_hal::reg16(native_hal::addr::kOCR1A))
+#define OCR1B (*native_hal::reg16(native_hal::addr::kOCR1B))
+#define TCCR2A (*native_hal::reg8(native_hal::addr::kTCCR2A))
+#define TCCR2B (*native_hal::reg8(native_hal::addr::kTCCR2B))
+#define TCNT2 (*native_hal::reg8(native_hal::addr::kTCNT2))
+#define OCR2A (*native_hal::reg8(native_hal::addr::kOCR2A))
+#define OCR2B (*native_hal::reg8(native_hal::addr::kOCR2B))
+#define UCSR0A (*native_hal::reg8(native_hal::addr::kUCSR0A))
+#define UCSR0B (*native_hal::reg8(native_hal::addr::kUCSR0B))
+#define UCSR0C (*native_hal::reg8(native_hal::addr::kUCSR0C))
+#define UBRR0L (*native_hal::reg8(native_hal::addr::kUBRR0L))
+#define UBRR0H (*native_hal::reg8(native_hal::addr::kUBRR0H))
+#define UDR0 (*native_hal::reg8(native_hal::addr::kUDR0))
+
+// Индексы битов регистров (те же значения, что и в iom328p.h).
+#define COM1A1 7
+#define COM1A0 6
+#define COM1B1 5
+#define COM1B0 4
+#define WGM11 1
+#define WGM10 0
+#define ICNC1 7
+#define ICES1 6
+#define WGM13 4
+#define WGM12 3
+#define CS12 2
+#define CS11 1
+#define CS10 0
+#define ICIE1 5
+#define OCIE1B 2
+#define OCIE1A 1
+#define TOIE1 0
+#define ICF1 5
+#define OCF1B 2
+#define OCF1A 1
+#define TOV1 0
+
+#define COM2A1 7
+#define COM2A0 6
+#define COM2B1 5
+#define COM2B0 4
+#define WGM21 1
+#define WGM20 0
+#define FOC2A 7
+#define FOC2B 6
+#define WGM22 3
+#define CS22 2
+#define CS21 1
+#define CS20 0
+#define OCIE2B 2
+#define OCIE2A 1
+#define TOIE2 0
+#define OCF2B 2
+#define OCF2A 1
+#define TOV2 0
+
+#define TSM 7
+#define PSRASY 1
+#define PSRSYNC 0
+
+#define ISC11 3
+#define ISC10 2
+#define ISC01 1
+#define ISC00 0
+#define INT1 1
+#define INT0 0
+#define INTF1 1
+#define INTF0 0
+
+#define RXC0 7
+#define TXC0 6
+#define UDRE0 5
+#define U2X0 1
+#define RXCIE0 7
+#define TXCIE0 6
+#define UDRIE0 5
+#define RXEN0 4
+#define TXEN0 3
+#define UDORD0 2
+#define UCPHA0 1
+
+// Прерывания. Обработчик вызывается стендом напрямую по имени вектора,
+// например TIMER2_COMPA_vect().
+#define ISR(vector) \
+  extern "C" void vector(void); \
+  void vector(void)
+
+inline void cli() {}
+inline void sei() {}
+
+#endif
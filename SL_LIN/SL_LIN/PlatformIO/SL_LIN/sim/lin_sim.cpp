@@ -0,0 +1,663 @@
+// Стенд прошивки с точностью до такта: настоящий firmware.elf в simavr. Собирается
+// в [env:sim] (платформа native, Linux, нужны libsimavr и libelf):
+//
+//   pio run -e nanoatmega328new && pio run -e sim
+//   .pio/build/sim/program [-f кадров] [-r seed] [-g пауза] [-q] [-v] firmware.elf [бод]...
+//
+// Для каждой скорости (по умолчанию 9600, 19200 и 20000) запускает ATmega328p с
+// нуля, настраивает его по UART как хост (C, Z1, B1, s<бод>, O) и подает на PD2
+// (RX трансивера) сигнал LIN из bench/lin_traffic.h: случайные кадры без помех,
+// пауза -g битов. Вывод UART разбирается как двоичный поток (host/record_stream.h)
+// и сверяется с переданными кадрами. Пока идет трафик, хост шлет по UART пустые
+// команды (CR) с полной скоростью линии, -q - без них.
+//
+// Такты считает simavr: ISR - от перехода на вектор до reti включительно (вложенные
+// прерывания входят во внешний), итерация loop() - от входа до следующего входа за
+// вычетом ISR. Пути ISR - по тому, что в этот момент на шине; пути loop() - по тому,
+// что итерация изменила: освободила кадр очереди (tail_frame_offset), прочитала байт
+// команды (rx_buffer_tail). Адреса loop() и этих переменных берутся из таблицы
+// символов ELF, поэтому loop() в main.cpp не встраивается.
+//
+// Бюджеты на скорость, bit - период бита в тактах:
+//   TIMER2_COMPA_vect (TIMER1_COMPA_vect при LIN_RX_EDGE_DECODER) <= bit / 2:
+//     выборка следующего бита и обслуживание UART укладываются в остаток бита;
+//   USART_RX_vect, USART_UDRE_vect <= bit / 8: ISR, начатый перед совпадением
+//     Timer2, сдвигает выборку не больше чем на 1/8 бита;
+//   итерация loop() <= kShortestFrameBits * bit: за итерацию выводится не больше
+//     одного кадра, очередь не растет на кадрах-заголовках вплотную.
+// Бюджеты НЕ ПРОВЕРЕНЫ: стенд еще ни разу не запускался на настоящем firmware.elf
+// (его писали без avr-gcc и simavr), доли бита взяты из модели bench/lin_bench.cpp.
+// Первый прогон может показать, что их нужно поправить; до этого FAIL в отчете -
+// повод проверить и прошивку, и сам бюджет.
+// -v печатает пути ISR по состояниям шины.
+//
+// Код возврата 1, если превышен бюджет, потерян или искажен кадр, 2 - ошибка
+// запуска. Скорость вне lin_processor::kMaxBaud прошивки отвергается командой s
+// (ошибка настройки в отчете).
+
+#include <elf.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include <simavr/avr_ioport.h>
+#include <simavr/avr_uart.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_interrupts.h>
+
+#include "custom_defs.h"
+#include "lin_processor.h"
+#include "lin_traffic.h"
+#include "record_stream.h"
+
+namespace {
+
+using traffic::kCpuHz;
+
+const uint32 kDefaultBauds[] = { 9600, 19200, 20000 };
+
+// Самый короткий кадр: разрыв 13, разделитель 1, синхронизация и PID.
+const uint32 kShortestFrameBits = 13 + 1 + 2 * 10;
+
+// Время от сброса до первой команды: setup() и init() Arduino.
+const uint64_t kBootCycles = kCpuHz / 20;
+// Время на ответы команд настройки и на вывод последних кадров.
+const uint64_t kSettleCycles = kCpuHz / 20;
+
+// Данные ELF AVR начинаются с этого адреса (адреса RAM в avr->data - без него).
+const uint32 kDataAddressBase = 0x800000;
+
+const uint8 kNumVectors = 26;
+const char* const kVectorNames[kNumVectors] = {
+  "RESET",        "INT0_vect",         "INT1_vect",         "PCINT0_vect",       "PCINT1_vect",
+  "PCINT2_vect",  "WDT_vect",          "TIMER2_COMPA_vect", "TIMER2_COMPB_vect", "TIMER2_OVF_vect",
+  "TIMER1_CAPT_vect", "TIMER1_COMPA_vect", "TIMER1_COMPB_vect", "TIMER1_OVF_vect", "TIMER0_COMPA_vect",
+  "TIMER0_COMPB_vect", "TIMER0_OVF_vect", "SPI_STC_vect",     "USART_RX_vect",     "USART_UDRE_vect",
+  "USART_TX_vect", "ADC_vect",         "EE_READY_vect",     "ANALOG_COMP_vect",  "TWI_vect",
+  "SPM_READY_vect",
+};
+
+const uint8 kVectorInt0 = 1;
+const uint8 kVectorTimer2CompA = 7;
+const uint8 kVectorTimer1CompA = 11;
+const uint8 kVectorUsartRx = 18;
+const uint8 kVectorUsartUdre = 19;
+
+// Пути loop(): биты - что изменила итерация.
+namespace loop_paths {
+static const uint8 IDLE = 0;
+static const uint8 FRAME = 1;
+static const uint8 COMMAND = 2;
+static const uint8 FRAME_AND_COMMAND = 3;
+static const uint8 kCount = 4;
+}
+
+const char* const kLoopPathNames[loop_paths::kCount] = {
+  "loop(): idle", "loop(): frame output", "loop(): command input", "loop(): frame + command",
+};
+
+// Такты одного пути.
+struct CycleStats {
+  uint32 calls = 0;
+  uint64_t total = 0;
+  uint64_t min = UINT64_MAX;
+  uint64_t max = 0;
+
+  void add(uint64_t cycles) {
+    calls++;
+    total += cycles;
+    min = cycles < min ? cycles : min;
+    max = cycles > max ? cycles : max;
+  }
+};
+
+// ----- Символы ELF -----
+
+struct Symbol {
+  std::string name;
+  uint32 value;
+  uint8 type;
+};
+
+// Таблица символов ELF32 AVR (.symtab). simavr читает из ELF только образ памяти.
+bool readSymbols(const char* path, std::vector<Symbol>* symbols) {
+  FILE* file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  std::vector<uint8_t> image;
+  uint8_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    image.insert(image.end(), chunk, chunk + n);
+  }
+  fclose(file);
+
+  const Elf32_Ehdr* header = reinterpret_cast<const Elf32_Ehdr*>(image.data());
+  if (image.size() < sizeof(Elf32_Ehdr) || memcmp(header->e_ident, ELFMAG, SELFMAG) ||
+      header->e_ident[EI_CLASS] != ELFCLASS32 || header->e_machine != EM_AVR ||
+      header->e_shoff + uint64_t(header->e_shnum) * sizeof(Elf32_Shdr) > image.size()) {
+    fprintf(stderr, "%s: not an AVR ELF file\n", path);
+    return false;
+  }
+  const Elf32_Shdr* sections = reinterpret_cast<const Elf32_Shdr*>(image.data() + header->e_shoff);
+  for (uint16 i = 0; i < header->e_shnum; i++) {
+    const Elf32_Shdr& section = sections[i];
+    if (section.sh_type != SHT_SYMTAB || section.sh_link >= header->e_shnum) {
+      continue;
+    }
+    const Elf32_Shdr& strings = sections[section.sh_link];
+    if (section.sh_offset + uint64_t(section.sh_size) > image.size() ||
+        strings.sh_offset + uint64_t(strings.sh_size) > image.size()) {
+      break;
+    }
+    const Elf32_Sym* entries = reinterpret_cast<const Elf32_Sym*>(image.data() + section.sh_offset);
+    const char* names = reinterpret_cast<const char*>(image.data() + strings.sh_offset);
+    for (uint32 j = 0; j < section.sh_size / sizeof(Elf32_Sym); j++) {
+      const Elf32_Sym& entry = entries[j];
+      const uint8 type = ELF32_ST_TYPE(entry.st_info);
+      if ((type == STT_FUNC || type == STT_OBJECT) && entry.st_name < strings.sh_size) {
+        symbols->push_back({ names + entry.st_name, entry.st_value, type });
+      }
+    }
+  }
+  if (symbols->empty()) {
+    fprintf(stderr, "%s: no symbol table (stripped?)\n", path);
+    return false;
+  }
+  return true;
+}
+
+// Адрес функции name (байтовый, как avr->pc) или -1.
+int64_t functionAddress(const std::vector<Symbol>& symbols, const char* name) {
+  for (const Symbol& symbol : symbols) {
+    if (symbol.type == STT_FUNC && symbol.name == name) {
+      return symbol.value;
+    }
+  }
+  return -1;
+}
+
+// Адрес в avr->data статической переменной, в имени которой есть part (с LTO
+// локальные имена получают суффиксы), или -1.
+int64_t variableAddress(const std::vector<Symbol>& symbols, const char* part) {
+  for (const Symbol& symbol : symbols) {
+    if (symbol.type == STT_OBJECT && symbol.value >= kDataAddressBase && strstr(symbol.name.c_str(), part)) {
+      return symbol.value - kDataAddressBase;
+    }
+  }
+  return -1;
+}
+
+// ----- Прогон -----
+
+struct RunOptions {
+  const char* firmware_path;
+  std::vector<Symbol> symbols;
+  uint32 num_frames;
+  uint32 seed;
+  double frame_space_bits;
+  boolean host_commands;
+  boolean verbose;
+};
+
+class Simulation;
+
+// Параметр уведомления об изменении RUNNING вектора.
+struct VectorProbe {
+  Simulation* sim;
+  uint8 vector;
+};
+
+class Simulation {
+public:
+  Simulation(const RunOptions& options, uint32 baud)
+    : options_(options), baud_(baud), wave_(baud), avr_(nullptr) {}
+
+  // Прогнать трафик. false - simavr не запустился или прошивка упала.
+  bool run();
+
+  // Напечатать отчет. Возвращает число нарушений бюджетов и ошибок кадров.
+  uint32 report();
+
+private:
+  static void onVector(avr_irq_t* irq, uint32_t value, void* param);
+  static void onUartOutput(avr_irq_t* irq, uint32_t value, void* param);
+  static void onUartXon(avr_irq_t* irq, uint32_t value, void* param);
+  static void onUartXoff(avr_irq_t* irq, uint32_t value, void* param);
+
+  bool load();
+  void sendCommand(const char* command);
+  // Выполнять команды, пока не будет достигнут такт end_cycle.
+  bool runUntil(uint64_t end_cycle);
+  void vectorRunning(uint8 vector, boolean running);
+  void loopEntered();
+  uint8 readVariable(int64_t address) const {
+    return address < 0 ? 0 : avr_->data[address];
+  }
+  void checkFrame(const capture_log::Record& record);
+
+  const RunOptions& options_;
+  const uint32 baud_;
+  traffic::Waveform wave_;
+  std::vector<traffic::ExpectedFrame> expected_;
+
+  avr_t* avr_;
+  avr_irq_t* rx_pin_;
+  avr_irq_t* uart_input_;
+  VectorProbe probes_[kNumVectors];
+  boolean uart_xoff_ = false;
+  std::string host_output_;
+
+  // Такт начала сигнала LIN, до него на PD2 высокий уровень.
+  uint64_t traffic_start_ = UINT64_MAX;
+  uint64_t next_pin_cycle_ = 0;
+  uint8 pin_level_ = 1;
+  uint64_t next_host_byte_cycle_ = UINT64_MAX;
+
+  // Активные ISR: вектор и такт входа.
+  struct ActiveIsr {
+    uint8 vector;
+    uint64_t start_cycle;
+    uint8 kind;
+  };
+  std::vector<ActiveIsr> active_;
+  CycleStats isr_stats_[kNumVectors][traffic::kinds::kCount];
+
+  int64_t loop_address_ = -1;
+  int64_t tail_frame_offset_address_ = -1;
+  int64_t rx_buffer_tail_address_ = -1;
+  boolean in_loop_ = false;
+  uint64_t loop_start_cycle_ = 0;
+  // Такты ISR верхнего уровня с начала текущей итерации loop().
+  uint64_t loop_isr_cycles_ = 0;
+  uint8 loop_tail_frame_offset_ = 0;
+  uint8 loop_rx_buffer_tail_ = 0;
+  CycleStats loop_stats_[loop_paths::kCount];
+
+  RecordStream::Counters stream_counters_;
+  uint32 next_expected_ = 0;
+  uint32 matched_ = 0;
+  uint32 lost_ = 0;
+  uint32 corrupted_ = 0;
+  uint32 command_errors_ = 0;
+};
+
+void Simulation::onVector(avr_irq_t*, uint32_t value, void* param) {
+  VectorProbe* probe = static_cast<VectorProbe*>(param);
+  probe->sim->vectorRunning(probe->vector, value != 0);
+}
+
+void Simulation::onUartOutput(avr_irq_t*, uint32_t value, void* param) {
+  static_cast<Simulation*>(param)->host_output_.push_back(char(value));
+}
+
+void Simulation::onUartXon(avr_irq_t*, uint32_t, void* param) {
+  static_cast<Simulation*>(param)->uart_xoff_ = false;
+}
+
+void Simulation::onUartXoff(avr_irq_t*, uint32_t, void* param) {
+  static_cast<Simulation*>(param)->uart_xoff_ = true;
+}
+
+bool Simulation::load() {
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(options_.firmware_path, &firmware)) {
+    fprintf(stderr, "%s: simavr cannot load the firmware\n", options_.firmware_path);
+    return false;
+  }
+  // Сборка Arduino не пишет .mmcu в ELF.
+  if (!firmware.mmcu[0]) {
+    strcpy(firmware.mmcu, "atmega328p");
+  }
+  firmware.frequency = kCpuHz;
+  avr_ = avr_make_mcu_by_name(firmware.mmcu);
+  if (!avr_ || avr_init(avr_)) {
+    fprintf(stderr, "simavr: no core for %s\n", firmware.mmcu);
+    return false;
+  }
+  avr_load_firmware(avr_, &firmware);
+
+  rx_pin_ = avr_io_getirq(avr_, AVR_IOCTL_IOPORT_GETIRQ('D'), 2);
+  avr_raise_irq(rx_pin_, 1);
+
+  // Вывод UART - только в стенд, не в stdout simavr.
+  uint32_t flags = 0;
+  avr_ioctl(avr_, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+  flags &= ~AVR_UART_FLAG_STDIO;
+  avr_ioctl(avr_, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+  uart_input_ = avr_io_getirq(avr_, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+  avr_irq_register_notify(avr_io_getirq(avr_, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT), onUartOutput, this);
+  avr_irq_register_notify(avr_io_getirq(avr_, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XON), onUartXon, this);
+  avr_irq_register_notify(avr_io_getirq(avr_, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUT_XOFF), onUartXoff, this);
+
+  for (uint8 vector = 1; vector < kNumVectors; vector++) {
+    probes_[vector] = { this, vector };
+    avr_irq_t* irq = avr_get_interrupt_irq(avr_, vector);
+    if (irq) {
+      avr_irq_register_notify(irq + AVR_INT_IRQ_RUNNING, onVector, &probes_[vector]);
+    }
+  }
+
+  loop_address_ = functionAddress(options_.symbols, "loop");
+  tail_frame_offset_address_ = variableAddress(options_.symbols, "tail_frame_offset");
+  rx_buffer_tail_address_ = variableAddress(options_.symbols, "rx_buffer_tail");
+  if (loop_address_ < 0) {
+    fprintf(stderr, "%s: no loop() symbol, main loop paths are not measured\n", options_.firmware_path);
+  }
+  return true;
+}
+
+void Simulation::vectorRunning(uint8 vector, boolean running) {
+  const uint64_t cycle = avr_->cycle;
+  if (running) {
+    // Путь - что было на шине при входе. До начала трафика ISR не учитываются.
+    const uint8 kind = cycle >= traffic_start_ ? wave_.at(cycle - traffic_start_).kind : traffic::kinds::kCount;
+    active_.push_back({ vector, cycle, kind });
+    return;
+  }
+  if (active_.empty()) {
+    return;
+  }
+  const ActiveIsr isr = active_.back();
+  active_.pop_back();
+  const uint64_t cycles = cycle - isr.start_cycle;
+  if (active_.empty()) {
+    loop_isr_cycles_ += cycles;
+  }
+  if (isr.kind < traffic::kinds::kCount) {
+    isr_stats_[isr.vector][isr.kind].add(cycles);
+  }
+}
+
+void Simulation::loopEntered() {
+  const uint8 tail_frame_offset = readVariable(tail_frame_offset_address_);
+  const uint8 rx_buffer_tail = readVariable(rx_buffer_tail_address_);
+  if (in_loop_ && loop_start_cycle_ >= traffic_start_) {
+    uint8 path = loop_paths::IDLE;
+    if (tail_frame_offset != loop_tail_frame_offset_) {
+      path |= loop_paths::FRAME;
+    }
+    if (rx_buffer_tail != loop_rx_buffer_tail_) {
+      path |= loop_paths::COMMAND;
+    }
+    loop_stats_[path].add(avr_->cycle - loop_start_cycle_ - loop_isr_cycles_);
+  }
+  in_loop_ = true;
+  loop_start_cycle_ = avr_->cycle;
+  loop_isr_cycles_ = 0;
+  loop_tail_frame_offset_ = tail_frame_offset;
+  loop_rx_buffer_tail_ = rx_buffer_tail;
+}
+
+void Simulation::sendCommand(const char* command) {
+  for (const char* c = command; *c; c++) {
+    avr_raise_irq(uart_input_, uint8(*c));
+  }
+  avr_raise_irq(uart_input_, '\r');
+}
+
+bool Simulation::runUntil(uint64_t end_cycle) {
+  // Байт UART хоста: старт, 8 бит, стоп.
+  const uint64_t host_byte_cycles = uint64_t(kCpuHz) * 10 / custom_defs::kHostBaud;
+  while (avr_->cycle < end_cycle) {
+    const uint64_t cycle = avr_->cycle;
+    if (cycle >= next_pin_cycle_) {
+      const uint64_t t = cycle - traffic_start_;
+      const uint8 level = wave_.at(t).level;
+      if (level != pin_level_) {
+        pin_level_ = level;
+        avr_raise_irq(rx_pin_, level);
+      }
+      const uint64_t next_edge = wave_.nextEdge(t);
+      next_pin_cycle_ = next_edge == UINT64_MAX ? UINT64_MAX : traffic_start_ + next_edge;
+    }
+    if (cycle >= next_host_byte_cycle_) {
+      if (!uart_xoff_) {
+        avr_raise_irq(uart_input_, '\r');
+      }
+      next_host_byte_cycle_ += host_byte_cycles;
+    }
+    if (int64_t(avr_->pc) == loop_address_ && active_.empty()) {
+      loopEntered();
+    }
+    const int state = avr_run(avr_);
+    if (state == cpu_Done || state == cpu_Crashed) {
+      fprintf(stderr, "%u baud: firmware stopped at pc 0x%04x, cycle %llu\n", baud_, unsigned(avr_->pc),
+              (unsigned long long)avr_->cycle);
+      return false;
+    }
+  }
+  return true;
+}
+
+void Simulation::checkFrame(const capture_log::Record& record) {
+  if (record.info & capture_log::kInfoSummary) {
+    return;
+  }
+  // Кадр может прийти после потерянных: ищем его среди следующих ожидаемых.
+  const uint32 kSearchFrames = 8;
+  for (uint32 i = next_expected_; i < expected_.size() && i < next_expected_ + kSearchFrames; i++) {
+    const LinFrame& sent = expected_[i].frame;
+    boolean same = sent.num_bytes() == record.numBytes() && !(record.info & capture_log::kInfoStatus);
+    for (uint8 j = 0; same && j < sent.num_bytes(); j++) {
+      same = sent.get_byte(j) == record.bytes[j];
+    }
+    if (!same) {
+      continue;
+    }
+    lost_ += i - next_expected_;
+    matched_++;
+    next_expected_ = i + 1;
+    return;
+  }
+  corrupted_++;
+}
+
+bool Simulation::run() {
+  if (!load()) {
+    return false;
+  }
+  std::mt19937 rng(options_.seed);
+  traffic::Options traffic_options;
+  traffic_options.frame_space_bits = options_.frame_space_bits;
+  traffic::Generator generator(wave_, traffic_options, rng);
+  expected_.resize(options_.num_frames);
+  for (traffic::ExpectedFrame& frame : expected_) {
+    frame.frame = traffic::randomFrame(rng);
+    generator.append(frame, traffic_options.frame_space_bits);
+  }
+  // Пауза за последним кадром - его конец.
+  wave_.appendBits(1, traffic::kinds::IDLE, traffic_options.frame_space_bits + 1);
+
+  RecordStream stream([this](const capture_log::Record& record) { checkFrame(record); },
+                      [this](const char* line) {
+                        if (strchr(line, '\a')) {
+                          command_errors_++;
+                        }
+                      });
+
+  next_pin_cycle_ = UINT64_MAX;
+  if (!runUntil(kBootCycles)) {
+    return false;
+  }
+  // Пустая строка сбрасывает недописанную команду, как в lin_capture.
+  char baud_command[16];
+  snprintf(baud_command, sizeof(baud_command), "s%X", baud_);
+  const char* const commands[] = { "", "C", "Z1", "B1", baud_command, "O" };
+  for (const char* command : commands) {
+    sendCommand(command);
+  }
+  if (!runUntil(avr_->cycle + kSettleCycles)) {
+    return false;
+  }
+  stream.feed(reinterpret_cast<const uint8_t*>(host_output_.data()), host_output_.size(), 0);
+  host_output_.clear();
+
+  traffic_start_ = avr_->cycle;
+  next_pin_cycle_ = traffic_start_;
+  if (options_.host_commands) {
+    next_host_byte_cycle_ = traffic_start_;
+  }
+  // Вывод разбирается порциями, чтобы строка не росла на весь прогон.
+  const uint64_t traffic_end = traffic_start_ + wave_.endCycle();
+  const uint64_t kFeedCycles = kCpuHz / 100;
+  for (uint64_t cycle = traffic_start_; cycle < traffic_end + kSettleCycles; cycle += kFeedCycles) {
+    if (cycle >= traffic_end) {
+      next_host_byte_cycle_ = UINT64_MAX;
+    }
+    if (!runUntil(cycle + kFeedCycles)) {
+      return false;
+    }
+    stream.feed(reinterpret_cast<const uint8_t*>(host_output_.data()), host_output_.size(), 0);
+    host_output_.clear();
+  }
+  lost_ += expected_.size() - next_expected_;
+  stream_counters_ = stream.counters();
+  avr_terminate(avr_);
+  return true;
+}
+
+// Одна строка отчета: такты пути и бюджет (0 - не проверяется).
+boolean printStats(const char* name, const CycleStats& stats, uint64_t budget) {
+  if (!stats.calls) {
+    return true;
+  }
+  const boolean ok = !budget || stats.max <= budget;
+  char budget_text[32] = "";
+  if (budget) {
+    snprintf(budget_text, sizeof(budget_text), "%llu%s", (unsigned long long)budget, ok ? "" : " FAIL");
+  }
+  printf("  %-36s %10u %8llu %8.1f %8llu %8.2f %12s\n", name, stats.calls, (unsigned long long)stats.min,
+         double(stats.total) / stats.calls, (unsigned long long)stats.max, stats.max * 1e6 / kCpuHz,
+         budget_text);
+  return ok;
+}
+
+uint32 Simulation::report() {
+  const uint64_t bit_cycles = kCpuHz / baud_;
+  uint64_t budgets[kNumVectors] = {};
+  budgets[kVectorTimer2CompA] = bit_cycles / 2;
+  budgets[kVectorTimer1CompA] = bit_cycles / 2;
+  budgets[kVectorUsartRx] = bit_cycles / 8;
+  budgets[kVectorUsartUdre] = bit_cycles / 8;
+  const uint64_t loop_budget = kShortestFrameBits * bit_cycles;
+
+  const RecordStream::Counters& counters = stream_counters_;
+  printf("%u baud (bit %llu cycles): %u frames, matched %u, lost %u, corrupted %u, device drops %llu\n", baud_,
+         (unsigned long long)bit_cycles, unsigned(expected_.size()), matched_, lost_, corrupted_,
+         (unsigned long long)counters.lost_frames);
+  printf("  %-36s %10s %8s %8s %8s %8s %12s\n", "path", "calls", "min cy", "avg cy", "max cy", "max us",
+         "budget cy");
+  uint32 failures = lost_ + corrupted_ + command_errors_;
+  if (command_errors_) {
+    printf("  setup commands rejected: %u\n", command_errors_);
+  }
+  for (uint8 vector = 1; vector < kNumVectors; vector++) {
+    CycleStats total;
+    for (uint8 kind = 0; kind < traffic::kinds::kCount; kind++) {
+      const CycleStats& stats = isr_stats_[vector][kind];
+      if (stats.calls) {
+        total.calls += stats.calls;
+        total.total += stats.total;
+        total.min = stats.min < total.min ? stats.min : total.min;
+        total.max = stats.max > total.max ? stats.max : total.max;
+      }
+    }
+    if (!printStats(kVectorNames[vector], total, budgets[vector])) {
+      failures++;
+    }
+    if (options_.verbose && (vector == kVectorInt0 || vector == kVectorTimer2CompA || vector == kVectorTimer1CompA)) {
+      for (uint8 kind = 0; kind < traffic::kinds::kCount; kind++) {
+        char name[64];
+        snprintf(name, sizeof(name), "  %s", traffic::kKindNames[kind]);
+        printStats(name, isr_stats_[vector][kind], 0);
+      }
+    }
+  }
+  for (uint8 path = 0; path < loop_paths::kCount; path++) {
+    if (!printStats(kLoopPathNames[path], loop_stats_[path], loop_budget)) {
+      failures++;
+    }
+  }
+  printf("\n");
+  return failures;
+}
+
+}  // пространство имен
+
+static int usage() {
+  fprintf(stderr, "usage: program [-f frames] [-r seed] [-g bits] [-q] [-v] firmware.elf [baud]...\n");
+  return 2;
+}
+
+int main(int argc, char** argv) {
+  RunOptions options;
+  options.num_frames = 300;
+  options.seed = 1;
+  options.frame_space_bits = 10;
+  options.host_commands = true;
+  options.verbose = false;
+  int opt;
+  while ((opt = getopt(argc, argv, "f:r:g:qv")) != -1) {
+    switch (opt) {
+      case 'f':
+        options.num_frames = strtoul(optarg, nullptr, 0);
+        break;
+      case 'r':
+        options.seed = strtoul(optarg, nullptr, 0);
+        break;
+      case 'g':
+        options.frame_space_bits = atof(optarg);
+        break;
+      case 'q':
+        options.host_commands = false;
+        break;
+      case 'v':
+        options.verbose = true;
+        break;
+      default:
+        return usage();
+    }
+  }
+  if (optind >= argc) {
+    return usage();
+  }
+  options.firmware_path = argv[optind];
+  if (!readSymbols(options.firmware_path, &options.symbols)) {
+    return 2;
+  }
+  std::vector<uint32> bauds;
+  for (int i = optind + 1; i < argc; i++) {
+    const uint32 baud = strtoul(argv[i], nullptr, 0);
+    if (baud < lin_processor::kMinBaud) {
+      return usage();
+    }
+    bauds.push_back(baud);
+  }
+  if (bauds.empty()) {
+    bauds.assign(kDefaultBauds, kDefaultBauds + ARRAY_SIZE(kDefaultBauds));
+  }
+
+  printf("LIN firmware bench (simavr): %s, %u frames, seed %u, space %.1f bits, host commands %s\n\n",
+         options.firmware_path, options.num_frames, options.seed, options.frame_space_bits,
+         options.host_commands ? "on" : "off");
+  uint32 failures = 0;
+  for (uint32 baud : bauds) {
+    Simulation sim(options, baud);
+    if (!sim.run()) {
+      return 2;
+    }
+    failures += sim.report();
+  }
+  printf("%s\n", failures ? "FAIL" : "OK");
+  return failures ? 1 : 0;
+}
@@ -19,6 +19,10 @@ typedef int32_t int32;
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 
+// Барьер компилятора: обращения к памяти не переносятся через него. Ставится между
+// записью данных и индексом, по которому их читает другая сторона (ISR или main).
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+
 // Частные данные. Не использовать из других модулей.
 namespace avr_util_private {
 extern const byte kBitMaskArray[];
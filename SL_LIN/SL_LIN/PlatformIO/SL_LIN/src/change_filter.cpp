@@ -0,0 +1,183 @@
+#include "change_filter.h"
+
+#include "lin_ids.h"
+#include "passive_timer.h"
+#include "stats.h"
+
+namespace change_filter
+{
+  static const uint8 kNumIds = 64;
+  static const uint8 kMaxDataBytes = 8;
+  // Значение slots[] для ID, кадров которого еще не было.
+  static const uint8 kNoSlot = 0xff;
+
+  // 10 байт на ID. Контрольная сумма не хранится: при том же ID она определяется
+  // данными.
+  struct Entry
+  {
+    uint8 num_bytes;
+    uint8 data[kMaxDataBytes];
+    uint8 repeats;
+  };
+
+  // Записи выделяются ID в порядке появления на шине. На реальной шине ID
+  // намного меньше 64, поэтому 24 записи (240 байт вместо 640 на все ID).
+  static Entry cache[kMaxCachedIds];
+  // Номер записи каждого ID или kNoSlot.
+  static uint8 slots[kNumIds];
+  static uint8 num_slots;
+  // Номера занятых записей от последней использованной к самой давней.
+  static uint8 recent[kMaxCachedIds];
+  static boolean enabled = false;
+  static uint16 keep_alive_millis;
+  static PassiveTimer keep_alive_timer;
+  // Следующий ID для сводки. kNumIds - сводка не выводится.
+  static uint8 summary_cursor = kNumIds;
+
+  void setEnabled(boolean enable, uint16 keep_alive)
+  {
+    enabled = enable;
+    keep_alive_millis = keep_alive;
+    summary_cursor = kNumIds;
+    keep_alive_timer.restart();
+    for (uint8 i = 0; i < kNumIds; i++)
+    {
+      slots[i] = kNoSlot;
+    }
+    num_slots = 0;
+  }
+
+  boolean isEnabled()
+  {
+    return enabled;
+  }
+
+  // Переставить запись в начало recent[]. position - ее место в recent[].
+  static void moveToFront(uint8 position)
+  {
+    const uint8 slot = recent[position];
+    for (; position > 0; position--)
+    {
+      recent[position] = recent[position - 1];
+    }
+    recent[0] = slot;
+  }
+
+  // Запись для ID, кадров которого нет в кеше. При полном кеше освобождается запись
+  // ID, который дольше всех не появлялся. Возвращает место записи в recent[].
+  static uint8 allocateSlot(uint8 id)
+  {
+    uint8 slot;
+    if (num_slots < kMaxCachedIds)
+    {
+      slot = num_slots;
+      recent[num_slots] = slot;
+      num_slots++;
+    }
+    else
+    {
+      slot = recent[kMaxCachedIds - 1];
+      uint8 old_id = 0;
+      while (slots[old_id] != slot)
+      {
+        old_id++;
+      }
+      slots[old_id] = kNoSlot;
+      stats::countChangeFilterEviction();
+    }
+    slots[id] = slot;
+    cache[slot].num_bytes = 0xff;
+    cache[slot].repeats = 0;
+    return num_slots - 1;
+  }
+
+  boolean acceptFrame(const LinFrame &frame)
+  {
+    const uint8 n = frame.num_bytes();
+    const uint8 id = frame.get_byte(0) & 0x3f;
+    // Байты данных без PID и контрольной суммы.
+    const uint8 data_bytes = (n > 2) ? n - 2 : 0;
+
+    uint8 position;
+    if (slots[id] == kNoSlot)
+    {
+      position = allocateSlot(id);
+    }
+    else
+    {
+      position = 0;
+      while (recent[position] != slots[id])
+      {
+        position++;
+      }
+    }
+    moveToFront(position);
+    Entry &entry = cache[slots[id]];
+
+    if (entry.num_bytes == n)
+    {
+      uint8 i = 0;
+      while (i < data_bytes && entry.data[i] == frame.get_byte(i + 1))
+      {
+        i++;
+      }
+      if (i == data_bytes)
+      {
+        if (entry.repeats < 0xff)
+        {
+          entry.repeats++;
+        }
+        return false;
+      }
+    }
+
+    entry.num_bytes = n;
+    for (uint8 i = 0; i < data_bytes; i++)
+    {
+      entry.data[i] = frame.get_byte(i + 1);
+    }
+    return true;
+  }
+
+  boolean nextSummary(uint8 *pid, uint8 *repeats)
+  {
+    if (!enabled || !keep_alive_millis)
+    {
+      return false;
+    }
+
+    // Начать новую сводку, когда прошел период.
+    if (summary_cursor >= kNumIds)
+    {
+      if (keep_alive_timer.timeMillis() < keep_alive_millis)
+      {
+        return false;
+      }
+      keep_alive_timer.restart();
+      summary_cursor = 0;
+    }
+
+    while (summary_cursor < kNumIds)
+    {
+      const uint8 id = summary_cursor++;
+      if (slots[id] == kNoSlot)
+      {
+        continue;
+      }
+      Entry &entry = cache[slots[id]];
+      if (entry.repeats)
+      {
+        *pid = lin_ids::protectedId(id);
+        *repeats = entry.repeats;
+        entry.repeats = 0;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  uint8 numCachedIds()
+  {
+    return num_slots;
+  }
+} // namespace change_filter
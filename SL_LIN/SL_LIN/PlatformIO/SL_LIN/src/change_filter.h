@@ -0,0 +1,36 @@
+#ifndef CHANGE_FILTER_H
+#define CHANGE_FILTER_H
+
+#include "avr_util.h"
+#include "lin_frame.h"
+
+// Режим вывода только изменений. Хранит последний ответ каждого ID LIN и
+// пропускает к хосту кадр, только если его данные или длина изменились. Повторы
+// считаются и периодически выводятся сводкой (ID, число повторов).
+// Требуются вызовы из основного цикла, не из ISR.
+namespace change_filter
+{
+  // Не более стольких ID запоминается (не все 64 ID LIN - ради ОЗУ). Новый ID при
+  // полном кеше занимает запись ID, который дольше всех не появлялся на шине; его
+  // следующий кадр выводится как новый, а несведенные повторы теряются. Число таких
+  // вытеснений выводит команда I (строка ic, см. lawicel.cpp).
+  static const uint8 kMaxCachedIds = 24;
+
+  // Включить или выключить режим. При включении кеш очищается, поэтому первый кадр
+  // каждого ID выводится. keep_alive_millis - период сводки повторов, 0 - без сводки.
+  extern void setEnabled(boolean enabled, uint16 keep_alive_millis);
+  extern boolean isEnabled();
+
+  // Учесть принятый действительный кадр. Возвращает true, если его нужно вывести.
+  extern boolean acceptFrame(const LinFrame &frame);
+
+  // Следующая запись сводки повторов. Возвращает false, если выводить нечего. Иначе
+  // устанавливает PID и число повторов с прошлой сводки (не более 255) и сбрасывает
+  // счетчик. Вызывать, пока есть место в выходном буфере.
+  extern boolean nextSummary(uint8 *pid, uint8 *repeats);
+
+  // Число ID с записью в кеше, до kMaxCachedIds.
+  extern uint8 numCachedIds();
+} // namespace change_filter
+
+#endif
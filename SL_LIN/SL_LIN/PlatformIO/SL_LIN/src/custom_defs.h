@@ -3,6 +3,28 @@
 
 #include "avr_util.h"
 
+// Способ приема LIN RX. Выбирается при сборке, например -D LIN_RX_EDGE_DECODER=1.
+// 0 - выборка каждого бита по совпадению Timer2 (ISR на каждом бите, даже без трафика).
+// 1 - восстановление байтов по времени фронтов RX (INT0 + Timer1), ISR только на фронтах.
+#ifndef LIN_RX_EDGE_DECODER
+#define LIN_RX_EDGE_DECODER 0
+#endif
+
+// Прием выше 20000 бод при LIN_RX_EDGE_DECODER == 0 (lin_processor::kMaxBaud).
+// Пределы проверены только на стенде (bench/lin_bench.cpp), не на AVR, поэтому
+// по умолчанию выключен. 1 - включить, например -D LIN_RX_HIGH_SPEED=1.
+#ifndef LIN_RX_HIGH_SPEED
+#define LIN_RX_HIGH_SPEED 0
+#endif
+
+// Гистограммы времени ISR и основного цикла (isr_timing.h, команда H). Стоят
+// около 100 тактов на каждый вызов TIMER2_COMPA_vect и USART_RX_vect, поэтому
+// включаются только в диагностической сборке [env:nanoatmega328new_timing].
+// 0 - без измерений, команда H отвечает BEL.
+#ifndef ISR_TIMING
+#define ISR_TIMING 0
+#endif
+
 // Специальные параметры пользовательского приложения.
 //
 // Как и все другие файлы custom_*, этот файл должен быть адаптирован к конкретному приложению.
@@ -11,13 +33,20 @@ namespace custom_defs
 {
 
     // true для контрольной суммы LIN V2 (расширенная). false для контрольной суммы LIN версии 1.
+    // Тип суммы каждого ID определяется по первому правильному кадру (см. lin_ids.h),
+    // этот флаг задает тип только для передачи ID, которые еще не были приняты.
     const boolean kUseLinChecksumVersion2 = true;
 
-    // Скорость передачи данных по шине LIN в секунду.
+    // Скорость передачи данных по шине LIN в секунду после включения. Меняется командами
+    // S/s и автоопределением (G).
     // Поддерживаемый диапазон скоростей от 1000 до 20000. Если за пределами диапазона, используется тихое значение по умолчанию
     // бод 9600.
     const uint16 kLinSpeed = 19200;
 
+    // Скорость UART к компьютеру. Точные значения при 16 МГц: 1000000, 500000,
+    // 250000 (и 2000000). 115200 дает ошибку 2,1%, но поддерживается всеми хостами.
+    const uint32 kHostBaud = 115200;
+
 } // namepsace custom_defs
 
 #endif
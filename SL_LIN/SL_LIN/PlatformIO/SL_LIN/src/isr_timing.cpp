@@ -0,0 +1,123 @@
+#include "isr_timing.h"
+
+#include "lawicel.h"
+#include "lin_processor.h"
+#include "sio.h"
+
+namespace isr_timing
+{
+#if ISR_TIMING
+  namespace isr_timing_private
+  {
+    Histogram histograms[kinds::kCount];
+    uint8 timer2_top;
+    uint8 timer2_next_top;
+
+    void halve(Histogram &histogram)
+    {
+      for (uint8 i = 0; i < kNumBuckets; i++)
+      {
+        histogram.buckets[i] >>= 1;
+      }
+    }
+  } // namespace isr_timing_private
+
+  using namespace isr_timing_private;
+
+  // Буквы строк вывода по гистограммам kinds.
+  static const char kKindLetters[kinds::kCount] = {'l', 't', 'u', 'm'};
+
+  // Строки вывода по порядку: скорость, затем гистограммы kinds.
+  static const uint8 kLineBaud = 0;
+  static const uint8 kLineHistograms = 1;
+  static const uint8 kLineEnd = kLineHistograms + kinds::kCount;
+  // Вывод не идет.
+  static const uint8 kLineNone = 0xff;
+
+  // Самая длинная строка: "h", буква, 8 корзин и максимум по 4 цифры, CR.
+  static const uint8 kMaxLineSize = 2 + (kNumBuckets + 1) * 4 + 1;
+
+  static uint8 dump_line = kLineNone;
+  static boolean dump_reset;
+
+  // Начало текущей итерации основного цикла.
+  static uint16 loop_start_ticks;
+
+  boolean startDump(boolean reset)
+  {
+    dump_line = kLineBaud;
+    dump_reset = reset;
+    return true;
+  }
+
+  static void printHex16(uint16 value)
+  {
+    sio::printhex2((uint8)(value >> 8));
+    sio::printhex2((uint8)value);
+  }
+
+  // Гистограмму меняют ISR: она копируется и сбрасывается с запрещенными
+  // прерываниями, выводится копия.
+  static void printHistogram(uint8 kind)
+  {
+    cli();
+    const Histogram histogram = histograms[kind];
+    if (dump_reset)
+    {
+      histograms[kind] = Histogram();
+    }
+    sei();
+    sio::printchar('h');
+    sio::printchar(kKindLetters[kind]);
+    for (uint8 i = 0; i < kNumBuckets; i++)
+    {
+      printHex16(histogram.buckets[i]);
+    }
+    printHex16(histogram.max);
+    sio::printchar(CR);
+  }
+
+  static void printLine(uint8 line)
+  {
+    if (line == kLineBaud)
+    {
+      // Скорость, при которой сняты гистограммы.
+      const uint32 baud = lin_processor::baud();
+      sio::printchar('h');
+      sio::printchar('b');
+      sio::printhex2((uint8)(baud >> 16));
+      printHex16((uint16)baud);
+      sio::printchar(CR);
+      return;
+    }
+    printHistogram(line - kLineHistograms);
+  }
+
+  void loop()
+  {
+    const uint16 now = hardware_clock::ticksForNonIsr();
+    record(kinds::LOOP_DURATION, now - loop_start_ticks);
+    loop_start_ticks = now;
+
+    while (dump_line != kLineNone && sio::capacity() >= kMaxLineSize)
+    {
+      if (dump_line == kLineEnd)
+      {
+        sio::printchar(CR);
+        dump_line = kLineNone;
+        return;
+      }
+      printLine(dump_line++);
+    }
+  }
+#else
+  boolean startDump(boolean reset)
+  {
+    return false;
+  }
+
+  void loop()
+  {
+  }
+#endif
+} // namespace isr_timing
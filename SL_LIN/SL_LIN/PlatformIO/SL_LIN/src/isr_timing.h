@@ -0,0 +1,155 @@
+#ifndef ISR_TIMING_H
+#define ISR_TIMING_H
+
+#include "avr_util.h"
+#include "custom_defs.h"
+#include "hardware_clock.h"
+
+// Гистограммы времени прерываний и итерации основного цикла, чтобы проверять запас
+// по времени на каждой скорости LIN и замечать, когда новая функция его съедает.
+// Выводятся командой H (см. lawicel.h).
+//
+// Корзина 0 - значение 0, корзина i - от 2^(i-1) до 2^i - 1, последняя - от 64 и
+// больше. Когда счетчик корзины доходит до 0xffff, все корзины гистограммы делятся
+// пополам: доли корзин сохраняются. Наибольшее значение хранится отдельно.
+//
+// Собирается при ISR_TIMING (custom_defs.h), иначе функции пустые.
+namespace isr_timing
+{
+  // Гистограммы.
+  namespace kinds
+  {
+    // Задержка входа в TIMER2_COMPA_vect от совпадения Timer2, вместе с прологом
+    // ISR, в 0,5 мкс. Разрешение - один отсчет Timer2 (0,5, 2 или 4 мкс по
+    // пределителю). Задержка больше периода бита неотличима от меньшей.
+    static const uint8 TIMER2_LATENCY = 0;
+    // Время выполнения TIMER2_COMPA_vect в тиках Timer1 (4 мкс).
+    static const uint8 TIMER2_DURATION = 1;
+    // Время выполнения USART_RX_vect в тиках Timer1.
+    static const uint8 SERIAL_RX_DURATION = 2;
+    // Итерация основного цикла в тиках Timer1, вместе с прерываниями.
+    static const uint8 LOOP_DURATION = 3;
+    static const uint8 kCount = 4;
+  }
+
+  static const uint8 kNumBuckets = 8;
+
+  // Частные данные. Не использовать из других модулей.
+  namespace isr_timing_private
+  {
+    struct Histogram
+    {
+      uint16 buckets[kNumBuckets];
+      uint16 max;
+    };
+
+    extern Histogram histograms[kinds::kCount];
+
+    // TOP Timer2 текущего периода и последнее значение, записанное в OCR2A. В
+    // быстром ШИМ OCR2A буферизован: запись становится TOP только в BOTTOM, а
+    // чтение OCR2A возвращает буфер, то есть, возможно, TOP следующего периода.
+    extern uint8 timer2_top;
+    extern uint8 timer2_next_top;
+
+    // Разделить корзины пополам. Вызывается редко, поэтому не встраивается.
+    extern void halve(Histogram &histogram);
+  } // namespace isr_timing_private
+
+  // Добавить значение. Вызывается из ISR или из main для гистограммы, которую не
+  // меняют ISR.
+  static inline void record(uint8 kind, uint16 value)
+  {
+#if ISR_TIMING
+    isr_timing_private::Histogram &histogram = isr_timing_private::histograms[kind];
+    if (value > histogram.max)
+    {
+      histogram.max = value;
+    }
+    uint8 bucket = kNumBuckets - 1;
+    if (value < 64)
+    {
+      bucket = 0;
+      for (uint8 rest = value; rest; rest >>= 1)
+      {
+        bucket++;
+      }
+    }
+    if (++histogram.buckets[bucket] == 0xffff)
+    {
+      isr_timing_private::halve(histogram);
+    }
+#else
+    (void)kind;
+    (void)value;
+#endif
+  }
+
+  // Вызывается при каждой записи OCR2A, top - записанное значение.
+  static inline void timer2TopWritten(uint8 top)
+  {
+#if ISR_TIMING
+    isr_timing_private::timer2_next_top = top;
+#else
+    (void)top;
+#endif
+  }
+
+  // Вызывается при настройке Timer2 (TCNT2 = 0) с новым top. Первый период после
+  // смены скорости еще может досчитать до прежнего TOP, его задержка приблизительна.
+  static inline void timer2Restarted(uint8 top)
+  {
+#if ISR_TIMING
+    isr_timing_private::timer2_top = top;
+    isr_timing_private::timer2_next_top = top;
+#else
+    (void)top;
+#endif
+  }
+
+  // Вызывается первым в TIMER2_COMPA_vect. Сколько полных отсчетов Timer2 прошло с
+  // совпадения A. Счетчик стоит на TOP еще один отсчет после совпадения, затем
+  // считает с нуля. TOP берется из timer2_top, а не из OCR2A.
+  static inline uint8 timer2LateCounts()
+  {
+#if ISR_TIMING
+    const uint8 counts = TCNT2;
+    const uint8 top = isr_timing_private::timer2_top;
+    // За этим совпадением следует BOTTOM: буфер OCR2A становится TOP.
+    isr_timing_private::timer2_top = isr_timing_private::timer2_next_top;
+    return (counts == top) ? 0 : counts + 1;
+#else
+    return 0;
+#endif
+  }
+
+  // Отметка Timer1 на входе в ISR для recordIsrDuration().
+  static inline uint16 isrStartTicks()
+  {
+#if ISR_TIMING
+    return hardware_clock::ticksForIsr();
+#else
+    return 0;
+#endif
+  }
+
+  // Вызывается последним в ISR с отметкой isrStartTicks().
+  static inline void recordIsrDuration(uint8 kind, uint16 start_ticks)
+  {
+#if ISR_TIMING
+    record(kind, hardware_clock::ticksForIsr() - start_ticks);
+#else
+    (void)kind;
+    (void)start_ticks;
+#endif
+  }
+
+  // Начать вывод гистограмм (команда H). Строки выводятся из loop(), когда
+  // помещаются в выходной буфер. reset - обнулять гистограммы по мере вывода.
+  // Возвращает false, если прошивка собрана без ISR_TIMING.
+  extern boolean startDump(boolean reset);
+
+  // Вызывается из основного цикла на каждой итерации. Измеряет итерацию.
+  extern void loop();
+} // namespace isr_timing
+
+#endif
@@ -2,6 +2,11 @@
 #include "system_clock.h"
 #include "sio.h"
 #include "lin_transmitter.h"
+#include "lin_processor.h"
+#include "change_filter.h"
+#include "scheduler.h"
+#include "stats.h"
+#include "isr_timing.h"
 
 namespace lawicel
 {
@@ -10,6 +15,7 @@ namespace lawicel
   static uint8 bufferRX[kQueueRXSize + 2];
   uint8 RX_Index;
   bool isConnected = false;
+  bool timestampsEnabled = false;
   uint8 id;
   uint8 dlc;
 
@@ -44,6 +50,32 @@ namespace lawicel
     case COMMAND::COMMAND_TIME_STAMP:
       return receiveTimestampCommand();
 
+    case COMMAND::COMMAND_BINARY_MODE:
+      return receiveBinaryModeCommand();
+
+    case COMMAND::COMMAND_ACCEPTANCE_CODE:
+      return receiveAcceptanceCodeCommand();
+
+    case COMMAND::COMMAND_ACCEPTANCE_MASK:
+      return receiveAcceptanceMaskCommand();
+
+    case COMMAND::COMMAND_CHANGES_ONLY:
+      return receiveChangesOnlyCommand();
+
+    case COMMAND::COMMAND_AUTOBAUD:
+      return receiveAutobaudCommand();
+
+    case COMMAND::COMMAND_SCHEDULE:
+      return receiveScheduleCommand();
+
+    case COMMAND::COMMAND_RESPONSE:
+      return receiveResponseCommand();
+
+    case COMMAND::COMMAND_STATISTICS:
+      return receiveStatisticsCommand();
+    case COMMAND::COMMAND_HISTOGRAMS:
+      return receiveHistogramsCommand();
+
     default:
     {
       return sio::printchar(BEL);
@@ -85,38 +117,36 @@ namespace lawicel
     {
       return sio::printchar(BEL);
     }
+    // Коды скоростей CAN заменены стандартными скоростями LIN по возрастанию.
+    uint16 baud;
     switch (bufferRX[1])
     {
     case '0':
-      // bitrate = CAN_10KBPS;
+      baud = 1000;
       break;
     case '1':
-      // bitrate = CAN_20KBPS;
+      baud = 2400;
       break;
     case '2':
-      // bitrate = CAN_50KBPS;
+      baud = 4800;
       break;
     case '3':
-      // bitrate = CAN_100KBPS;
+      baud = 9600;
       break;
     case '4':
-      // bitrate = CAN_125KBPS;
+      baud = 10417;
       break;
     case '5':
-      // bitrate = CAN_250KBPS;
+      baud = 19200;
       break;
     case '6':
-      // bitrate = CAN_500KBPS;
-      break;
-    case '7':
-      return sio::printchar(BEL);
-    case '8':
-      // bitrate = CAN_1000KBPS;
+      baud = 20000;
       break;
     default:
       return sio::printchar(BEL);
     }
 
+    lin_processor::setBaud(baud);
     return sio::printchar(CR);
   }
 
@@ -150,7 +180,11 @@ namespace lawicel
       char loHex = bufferRX[offset++];
       Transmit_Data[i] = hexCharToByte(loHex) + (hexCharToByte(hiHex) << 4);
     }
-    lin_transmitter::writeLin(id, Transmit_Data, dlc);
+    // Предыдущий кадр еще не передан.
+    if (!lin_transmitter::writeLin(id, Transmit_Data, dlc))
+    {
+      return sio::printchar(BEL);
+    }
     return sio::printchar(CR);
   }
 
@@ -163,8 +197,10 @@ namespace lawicel
     switch (bufferRX[1])
     {
     case '0':
+      timestampsEnabled = false;
       return sio::printchar(CR);
     case '1':
+      timestampsEnabled = true;
       return sio::printchar(CR);
     default:
       return sio::printchar(BEL);
@@ -172,12 +208,336 @@ namespace lawicel
     return;
   }
 
-  void receiveSetBtrCommand()
+  void receiveBinaryModeCommand()
+  {
+    if (RX_Index != 2)
+    {
+      return sio::printchar(BEL);
+    }
+    switch (bufferRX[1])
+    {
+    case '0':
+      sio::setBinaryMode(false);
+      return sio::printchar(CR);
+    case '1':
+      sio::setBinaryMode(true);
+      return sio::printchar(CR);
+    default:
+      return sio::printchar(BEL);
+    }
+  }
+
+  // Фильтр приема как в SLCAN: Mxxxxxxxx - код ACR0..ACR3, mxxxxxxxx - маска
+  // AMR0..AMR3 SJA1000 в режиме одного фильтра, бит маски 1 - "не важно". 11-битный
+  // ID стоит в битах 31..21 (ACR0 и старшие 3 бита ACR1), ID LIN - это ID 0x000..0x03F,
+  // как в команде t. ID принимается, если ((id ^ code) & ~mask) == 0 в этих битах;
+  // RTR и байты данных (биты 20..0) не проверяются. По умолчанию M00000000,
+  // mFFFFFFFF - все ID.
+  // Mxxxxxxxxxxxxxxxx (16 цифр) задает произвольный набор ID напрямую: 64-битная
+  // маска, бит n - ID n.
+  static uint32 acceptanceCode = 0;
+  static uint32 acceptanceMask = 0xFFFFFFFF;
+
+  static uint32 parseHex32(uint8 offset)
+  {
+    uint32 result = 0;
+    for (uint8 i = 0; i < 8; i++)
+    {
+      result = (result << 4) | hexCharToByte(bufferRX[offset + i]);
+    }
+    return result;
+  }
+
+  // Положение 11-битного ID в коде и маске.
+  static const uint8 kAcceptanceIdShift = 21;
+
+  static void applyAcceptanceFilter()
+  {
+    uint8 bitmap[8];
+    for (uint8 i = 0; i < 8; i++)
+    {
+      bitmap[i] = 0;
+    }
+    const uint16 code = (uint16)(acceptanceCode >> kAcceptanceIdShift);
+    const uint16 careBits = (uint16)(~acceptanceMask >> kAcceptanceIdShift);
+    for (uint8 id = 0; id < 64; id++)
+    {
+      if (((id ^ code) & careBits) == 0)
+      {
+        bitmap[id >> 3] |= (1 << (id & 7));
+      }
+    }
+    lin_processor::setIdFilter(bitmap);
+  }
+
+  void receiveAcceptanceCodeCommand()
+  {
+    if (isConnected == 1)
+    {
+      return sio::printchar(BEL);
+    }
+    if (RX_Index == 9)
+    {
+      acceptanceCode = parseHex32(1);
+      applyAcceptanceFilter();
+      return sio::printchar(CR);
+    }
+    if (RX_Index == 17)
+    {
+      // Старшая цифра - ID 0x3F..0x3C, младшая - ID 0x03..0x00.
+      const uint32 high = parseHex32(1);
+      const uint32 low = parseHex32(9);
+      uint8 bitmap[8];
+      for (uint8 i = 0; i < 4; i++)
+      {
+        bitmap[i] = (uint8)(low >> (8 * i));
+        bitmap[i + 4] = (uint8)(high >> (8 * i));
+      }
+      lin_processor::setIdFilter(bitmap);
+      return sio::printchar(CR);
+    }
+    return sio::printchar(BEL);
+  }
+
+  void receiveAcceptanceMaskCommand()
   {
     if (isConnected == 1)
     {
       return sio::printchar(BEL);
     }
+    if (RX_Index != 9)
+    {
+      return sio::printchar(BEL);
+    }
+    acceptanceMask = parseHex32(1);
+    applyAcceptanceFilter();
+    return sio::printchar(CR);
+  }
+
+  // Период сводки повторов по умолчанию для D1, мс.
+  static const uint16 kDefaultKeepAliveMillis = 1000;
+
+  void receiveChangesOnlyCommand()
+  {
+    if (RX_Index == 2 && bufferRX[1] == '0')
+    {
+      change_filter::setEnabled(false, 0);
+      return sio::printchar(CR);
+    }
+    if (RX_Index == 2 && bufferRX[1] == '1')
+    {
+      change_filter::setEnabled(true, kDefaultKeepAliveMillis);
+      return sio::printchar(CR);
+    }
+    if (RX_Index == 6 && bufferRX[1] == '1')
+    {
+      uint16 keepAlive = 0;
+      for (uint8 i = 2; i < 6; i++)
+      {
+        keepAlive = (keepAlive << 4) | hexCharToByte(bufferRX[i]);
+      }
+      change_filter::setEnabled(true, keepAlive);
+      return sio::printchar(CR);
+    }
+    return sio::printchar(BEL);
+  }
+
+  void receiveAutobaudCommand()
+  {
+    if (isConnected == 1 || RX_Index != 2)
+    {
+      return sio::printchar(BEL);
+    }
+    switch (bufferRX[1])
+    {
+    case '0':
+      lin_processor::setAutobaudMode(lin_processor::autobaud_modes::OFF);
+      break;
+    case '1':
+      lin_processor::setAutobaudMode(lin_processor::autobaud_modes::STANDARD);
+      break;
+    case '2':
+      lin_processor::setAutobaudMode(lin_processor::autobaud_modes::EXACT);
+      break;
+    default:
+      return sio::printchar(BEL);
+    }
+    return sio::printchar(CR);
+  }
+
+  // sxxxx: произвольная скорость, xxxx - бод в hex (например, s28B1 = 10417).
+  static uint16 parseHex16(uint8 offset, uint8 digits)
+  {
+    uint16 result = 0;
+    for (uint8 i = 0; i < digits; i++)
+    {
+      result = (result << 4) | hexCharToByte(bufferRX[offset + i]);
+    }
+    return result;
+  }
+
+  // Таблица периодической передачи, по строке на ID из списка TxList (.txl):
+  // K0, K1 - остановить, запустить;
+  // Kc - остановить и очистить;
+  // Ktiiildd..pppp - добавить ID iii (hex, как в t, можно PID) с l байтами данных и периодом
+  // pppp мс (hex, 0001..7FFF), l = 0 - только заголовок;
+  // Kuiiildd.. - заменить данные ID без изменения фазы;
+  // Kdiii - удалить ID.
+  // Работает и при закрытом канале.
+  void receiveScheduleCommand()
+  {
+    if (RX_Index == 2 && bufferRX[1] == '0')
+    {
+      scheduler::stop();
+      return sio::printchar(CR);
+    }
+    if (RX_Index == 2 && bufferRX[1] == '1')
+    {
+      scheduler::start();
+      return sio::printchar(CR);
+    }
+    if (RX_Index == 2 && bufferRX[1] == 'c')
+    {
+      scheduler::clear();
+      return sio::printchar(CR);
+    }
+    if (RX_Index == 5 && bufferRX[1] == 'd')
+    {
+      return sio::printchar(scheduler::removeEntry(parseHex16(2, 3)) ? CR : BEL);
+    }
+    if (RX_Index < 6 || (bufferRX[1] != 't' && bufferRX[1] != 'u'))
+    {
+      return sio::printchar(BEL);
+    }
+
+    const uint16 lin_id = parseHex16(2, 3);
+    const uint8 data_size = hexCharToByte(bufferRX[5]);
+    const uint8 period_digits = bufferRX[1] == 't' ? 4 : 0;
+    if (lin_id > 0xff || data_size > 8 || RX_Index != 6 + 2 * data_size + period_digits)
+    {
+      return sio::printchar(BEL);
+    }
+    uint8 data[8];
+    for (uint8 i = 0; i < data_size; i++)
+    {
+      data[i] = parseHex16(6 + 2 * i, 2);
+    }
+
+    boolean ok;
+    if (period_digits)
+    {
+      ok = scheduler::setEntry(lin_id, data, data_size, parseHex16(6 + 2 * data_size, 4));
+    }
+    else
+    {
+      ok = scheduler::updateData(lin_id, data, data_size);
+    }
+    return sio::printchar(ok ? CR : BEL);
+  }
+
+  // Таблица ответов подчиненных устройств, строки как в K:
+  // Jc - очистить;
+  // Jtiiildd.. - отвечать на заголовок ID iii (hex, можно PID) l байтами данных
+  // (1..8), контрольная сумма добавляется устройством; повтор с тем же ID меняет
+  // данные без остановки приема;
+  // Jdiii - удалить ID.
+  // Работает и при закрытом канале.
+  void receiveResponseCommand()
+  {
+    if (RX_Index == 2 && bufferRX[1] == 'c')
+    {
+      lin_processor::clearResponses();
+      return sio::printchar(CR);
+    }
+    if (RX_Index == 5 && bufferRX[1] == 'd')
+    {
+      return sio::printchar(lin_processor::removeResponse(parseHex16(2, 3)) ? CR : BEL);
+    }
+    if (RX_Index < 6 || bufferRX[1] != 't')
+    {
+      return sio::printchar(BEL);
+    }
+
+    const uint16 lin_id = parseHex16(2, 3);
+    const uint8 data_size = hexCharToByte(bufferRX[5]);
+    if (lin_id > 0xff || data_size > 8 || RX_Index != 6 + 2 * data_size)
+    {
+      return sio::printchar(BEL);
+    }
+    uint8 data[8];
+    for (uint8 i = 0; i < data_size; i++)
+    {
+      data[i] = parseHex16(6 + 2 * i, 2);
+    }
+    return sio::printchar(lin_processor::setResponse(lin_id, data, data_size) ? CR : BEL);
+  }
+
+  // Счетчики stats, строки hex по мере места в выходном буфере, в конце пустая
+  // строка (CR):
+  // iuUUUUUUUU - время работы, с;
+  // ieEEEE x8 - ошибки приема по битам lin_processor::errors, от бита 0;
+  // ifFFFF x4 - кадры со статусом LinFrame 1..4 (четность PID, сумма, длинный,
+  // короткий);
+  // isRRRRTTTT - байты, потерянные при приеме от хоста и передаче хосту;
+  // iqQQSSTTTTSSSS - наибольшее заполнение очереди кадров и ее размер, то же для
+  // выходного буфера, в байтах;
+  // icNNLLCCCC - режим изменений (D1): занято записей кеша ID и их число (24 из
+  // 64 ID), записи, отданные новому ID при полном кеше (см. change_filter.h);
+  // inIICCCCEE - по строке на ID II с кадрами: правильные кадры, кадры с ошибкой
+  // (до ff).
+  // Ir обнуляет счетчики по мере вывода. Работает и при закрытом канале.
+  void receiveStatisticsCommand()
+  {
+    if (RX_Index == 1)
+    {
+      return stats::startDump(false);
+    }
+    if (RX_Index == 2 && bufferRX[1] == 'r')
+    {
+      return stats::startDump(true);
+    }
+    return sio::printchar(BEL);
+  }
+
+  // Гистограммы isr_timing, строки hex по мере места в выходном буфере, в конце
+  // пустая строка (CR):
+  // hbBBBBBB - текущая скорость LIN, бод;
+  // hK + 8 корзин по 4 цифры + MMMM (наибольшее значение) - по строке на
+  // гистограмму: hl - задержка входа в TIMER2_COMPA_vect, 0,5 мкс; ht - время
+  // TIMER2_COMPA_vect, hu - время USART_RX_vect, hm - итерация основного цикла, все
+  // три в тиках по 4 мкс. Корзины: 0, 1, 2-3, 4-7, ..., 64 и больше.
+  // Hr обнуляет гистограммы по мере вывода. Без ISR_TIMING в прошивке (по умолчанию, см.
+  // custom_defs.h) - BEL.
+  void receiveHistogramsCommand()
+  {
+    if (RX_Index == 1 && isr_timing::startDump(false))
+    {
+      return;
+    }
+    if (RX_Index == 2 && bufferRX[1] == 'r' && isr_timing::startDump(true))
+    {
+      return;
+    }
+    return sio::printchar(BEL);
+  }
+
+  void receiveSetBtrCommand()
+  {
+    // 4 цифры, 5 - для скоростей выше 0xffff.
+    if (isConnected == 1 || RX_Index < 5 || RX_Index > 6)
+    {
+      return sio::printchar(BEL);
+    }
+    uint32 baud = 0;
+    for (uint8 i = 1; i < RX_Index; i++)
+    {
+      baud = (baud << 4) | hexCharToByte(bufferRX[i]);
+    }
+    if (baud < lin_processor::kMinBaud || baud > lin_processor::kMaxBaud)
+    {
+      return sio::printchar(BEL);
+    }
+    lin_processor::setBaud(baud);
     return sio::printchar(CR);
   }
 
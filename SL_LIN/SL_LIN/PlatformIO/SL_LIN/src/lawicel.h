@@ -8,6 +8,8 @@
 namespace lawicel
 {
   extern bool isConnected;
+  // Z1: кадры выводятся с меткой времени.
+  extern bool timestampsEnabled;
   extern uint8 RX_Index;
   extern uint8 id;
   extern uint8 dlc;
@@ -21,8 +23,8 @@ namespace lawicel
 
   enum COMMAND : char
   {
-    COMMAND_SET_BITRATE = 'S',    // установить битрейт LIN
-    COMMAND_SET_BTR = 's',        // установить битрейт LIN через
+    COMMAND_SET_BITRATE = 'S',    // установить битрейт LIN: S0..S6 - 1000, 2400, 4800, 9600, 10417, 19200, 20000
+    COMMAND_SET_BTR = 's',        // установить битрейт LIN через sxxxx или sxxxxx - бод в hex, lin_processor::kMinBaud..kMaxBaud
     COMMAND_OPEN_CAN_CHAN = 'O',  // открыть LIN-канал
     COMMAND_CLOSE_CAN_CHAN = 'C', // закрыть LIN-канал
     COMMAND_SEND_11BIT_ID = 't',  // отправить LIN-сообщение с 11bit ID
@@ -30,8 +32,30 @@ namespace lawicel
     COMMAND_GET_SW_VERSION = 'v', // получить только версию ПО
     COMMAND_GET_SERIAL = 'N',     // получить серийный номер устройства
     COMMAND_TIME_STAMP = 'Z',     // переключить настройку метки времени
+    COMMAND_BINARY_MODE = 'B',    // переключить вывод кадров: B0 - ASCII, B1 - двоичные записи
+    COMMAND_ACCEPTANCE_CODE = 'M', // установить код фильтра приема
+    COMMAND_ACCEPTANCE_MASK = 'm', // установить маску фильтра приема
+    COMMAND_CHANGES_ONLY = 'D',   // D0 - выводить все кадры, D1[xxxx] - только изменения (свои кадры "e" - все), сводка повторов раз в xxxx мс; в кеше 24 ID, новый ID вытесняет самый давний (см. I, строка ic)
+    COMMAND_AUTOBAUD = 'G',       // G0 - скорость kLinSpeed, G1 - автоопределение стандартной скорости, G2 - точной; A в LAWICEL - опрос всех кадров
+    COMMAND_SCHEDULE = 'K',       // таблица периодической передачи, см. receiveScheduleCommand(); L в LAWICEL - открыть канал только на прием
+    COMMAND_RESPONSE = 'J',       // таблица ответов подчиненных устройств, см. receiveResponseCommand(); R в LAWICEL - RTR с 29-битным ID
+    COMMAND_STATISTICS = 'I',     // I - вывести счетчики (stats), Ir - вывести и обнулить, см. receiveStatisticsCommand()
+    COMMAND_HISTOGRAMS = 'H',     // H - вывести гистограммы времени ISR (isr_timing), Hr - вывести и обнулить, см. receiveHistogramsCommand()
   };
 
+  // При автоопределении скорости захват сообщается строкой "a<бод>\r" (например,
+  // "a19200\r"), потеря захвата - "a0\r". В двоичном режиме (B1) - событием записи
+  // (sio::printBaudLock()).
+
+  // Строка кадра: "t", PID, пробел, DLC (число байтов данных), данные, при Z1 -
+  // метка времени (4 цифры, мс по модулю 60000), затем контрольная сумма, CR.
+  // Сумма стоит после полей LAWICEL, чтобы разбор по DLC не принял ее за метку.
+
+  // Кадр, переданный командой t или таблицей K и прочитанный с шины без ошибок
+  // битов, выводится в формате "t", но с буквой "e" (для заголовка - вместе с
+  // ответом подчиненного устройства). Нет строки "e" - кадра на шине не было.
+  // Так же выводится кадр с ответом из таблицы J.
+
 
   extern void processChar(char rxChar);
   extern void process();
@@ -42,6 +66,15 @@ namespace lawicel
   extern void receiveTransmitCommand();
   extern void receiveTimestampCommand();
   extern void receiveSetBtrCommand();
+  extern void receiveBinaryModeCommand();
+  extern void receiveAcceptanceCodeCommand();
+  extern void receiveAcceptanceMaskCommand();
+  extern void receiveChangesOnlyCommand();
+  extern void receiveAutobaudCommand();
+  extern void receiveScheduleCommand();
+  extern void receiveResponseCommand();
+  extern void receiveStatisticsCommand();
+  extern void receiveHistogramsCommand();
 
   unsigned char hexCharToByte(char hex);
   extern unsigned char getDlc(uint8 n);
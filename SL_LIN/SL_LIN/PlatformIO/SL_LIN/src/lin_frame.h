@@ -2,9 +2,16 @@
 #define LIN_FRAME_H
 
 #include "avr_util.h"
+#include "lin_ids.h"
 
 // Буфер для одного кадра.
-class LinFrame {
+//
+// Поля расположены так, что первые recordSize() байтов объекта - полная запись
+// кадра: байт сведений (длина, статус, признак передачи), метка времени и сами
+// байты. Очередь приема (lin_processor) хранит кадры такими записями подряд, без
+// выравнивания, и читает их через LinFrame без копирования. Поля после bytes_
+// нужны только при сборке кадра в ISR.
+class __attribute__((packed)) LinFrame {
 public:
   LinFrame() {
     reset();
@@ -17,22 +24,75 @@ public:
   // Количество байтов в самом длинном фрейме. Один байт идентификатора, 8 байтов данных, один байт контрольной суммы.
   static const uint8 kMaxBytes = 1 + 8 + 1;
 
-  // Вычислить контрольные биты [P1,P0] идентификатора lin в битах [5:0] и вернуть
-  // [P1,P0][5:0] — проводное представление этого идентификатора.
-  static uint8 setLinIdChecksumBits(uint8 id);
+  // Результат проверки кадра, status().
+  static const uint8 kStatusOk = 0;
+  static const uint8 kStatusPidParity = 1;
+  // Сумма не совпала с типом, выученным для ID (или ни с одним из типов).
+  static const uint8 kStatusChecksum = 2;
+  // Больше kMaxBytes байтов. В кадре первые kMaxBytes.
+  static const uint8 kStatusTooLong = 3;
+  // PID и один байт: ни заголовок, ни кадр с данными и суммой.
+  static const uint8 kStatusTooShort = 4;
 
-  boolean isValid() const;
+  // Проверить длину, четность PID и контрольную сумму и записать status().
+  // Вызывается из ISR приема, когда кадр закончен: сумма данных к этому времени уже
+  // накоплена в append_byte(), поэтому кадр не просматривается заново. Тип суммы ID
+  // запоминается по первому действительному кадру (lin_ids::acceptChecksum()).
+  void validate();
 
-  // Вычисление контрольной суммы кадра LIN. Предположим, что в буфере есть хотя бы один байт. Действительный
+  // Результат validate() или set_status().
+  inline uint8 status() const {
+    return (info_ & kInfoStatusMask) >> kInfoStatusShift;
+  }
+
+  inline void set_status(uint8 status) {
+    info_ = (info_ & ~kInfoStatusMask) | (status << kInfoStatusShift);
+  }
+
+  inline boolean isValid() const {
+    return !(info_ & kInfoStatusMask);
+  }
+
+  // Вычисление контрольной суммы кадра LIN. Предположим, что в буфере есть хотя бы два байта. Действительный
   // фрейм должен содержать один байт для id, 1-8 байт для данных, один байт для контрольной суммы.
-  uint8 computeChecksum() const;
+  // enhanced - расширенная сумма (LIN 2.x, включает PID), иначе классическая.
+  inline uint8 computeChecksum(boolean enhanced) const {
+    return (uint8)~(enhanced ? lin_ids::addWithCarry(data_sum_, bytes_[0]) : data_sum_);
+  }
 
   inline void reset() {
-    num_bytes_ = 0;
+    info_ = 0;
+    data_sum_ = 0;
+  }
+
+  // Заголовок (lin_processor::transmitFrame()) или ответ (lin_processor::setResponse())
+  // передан этим устройством и прочитан с шины без ошибок битов.
+  inline boolean transmitted() const {
+    return info_ & kInfoTransmitted;
+  }
+
+  inline void set_transmitted(boolean transmitted) {
+    info_ = transmitted ? (info_ | kInfoTransmitted) : (info_ & ~kInfoTransmitted);
+  }
+
+  // Время начала байта синхронизации в тиках hardware_clock (4 мкс). При сборке
+  // кадра ISR записывает 16-битное значение часов, а перед постановкой в очередь
+  // расширяет его до 32 бит в шкале system_clock::timeTicks().
+  inline uint32 timestamp_ticks() const {
+    return timestamp_ticks_;
+  }
+
+  inline void set_timestamp_ticks(uint32 ticks) {
+    timestamp_ticks_ = ticks;
   }
 
   inline uint8 num_bytes() const {
-    return num_bytes_;
+    return info_ & kInfoNumBytesMask;
+  }
+
+  // Размер записи кадра в очереди приема: байт сведений, метка времени, байты кадра.
+  inline uint8 recordSize() const {
+    return kRecordHeaderSize + num_bytes();
   }
 
   // Получить байт кадра заданного индекса.
@@ -46,18 +106,44 @@ public:
 
   // Вызывающий должен проверить, что num_bytes < kMaxBytes;
   inline void append_byte(uint8 value) {
-    bytes_[num_bytes_++] = value;
+    const uint8 n = num_bytes();
+    // Сумма отстает на байт: последний байт кадра - сама контрольная сумма.
+    if (n >= 2) {
+      data_sum_ = lin_ids::addWithCarry(data_sum_, bytes_[n - 1]);
+    }
+    bytes_[n] = value;
+    // Длина в младших битах info_, переноса в статус нет (n < kMaxBytes).
+    info_++;
   }
 
   // TODO: сделайте это приватным, не жертвуя производительностью.
 
 private:
-  // Количество байтов в bytes_buffer. Максимум kMaxBytes.
-  uint8 num_bytes_;
+  // Биты info_.
+  static const uint8 kInfoNumBytesMask = 0x0f;
+  static const uint8 kInfoStatusShift = 4;
+  static const uint8 kInfoStatusMask = 0x70;
+  static const uint8 kInfoTransmitted = 0x80;
+
+  // info_ и timestamp_ticks_.
+  static const uint8 kRecordHeaderSize = 5;
+
+  // ----- Запись кадра -----
+
+  // Количество байтов в bytes_ (максимум kMaxBytes), status() и transmitted().
+  uint8 info_;
+
+  // См. timestamp_ticks().
+  uint32 timestamp_ticks_;
 
   // Полученные байты кадра. Включает идентификатор, данные и контрольную сумму. Не
   // включить байт синхронизации 0x55.
   uint8 bytes_[kMaxBytes];
+
+  // ----- Только при сборке кадра -----
+
+  // Классическая сумма (с переносами) байтов данных, без PID и последнего байта.
+  uint8 data_sum_;
 };
 
 #endif
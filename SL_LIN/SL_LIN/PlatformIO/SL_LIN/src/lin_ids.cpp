@@ -0,0 +1,157 @@
+#include "lin_ids.h"
+
+#include "custom_defs.h"
+
+namespace lin_ids
+{
+  // Признаки ID в таблице.
+  static const uint8 kClassicChecksumOnly = (1 << 0);
+
+  struct IdInfo
+  {
+    uint8 pid;
+    uint8 flags;
+  };
+
+  // P0 = ID0 ^ ID1 ^ ID2 ^ ID4, P1 = !(ID1 ^ ID3 ^ ID4 ^ ID5).
+  static constexpr uint8 bitOf(uint8 id, uint8 bit)
+  {
+    return (id >> bit) & 1;
+  }
+
+  static constexpr uint8 pidOf(uint8 id)
+  {
+    return (uint8)(id | ((bitOf(id, 0) ^ bitOf(id, 1) ^ bitOf(id, 2) ^ bitOf(id, 4)) << 6) |
+                   ((1 ^ bitOf(id, 1) ^ bitOf(id, 3) ^ bitOf(id, 4) ^ bitOf(id, 5)) << 7));
+  }
+
+  static constexpr uint8 flagsOf(uint8 id)
+  {
+    // Диагностические запрос и ответ.
+    return (id == 0x3c || id == 0x3d) ? kClassicChecksumOnly : 0;
+  }
+
+  static_assert(pidOf(0x00) == 0x80 && pidOf(0x15) == 0x55 && pidOf(0x3c) == 0x3c && pidOf(0x3d) == 0x7d,
+                "Неверные биты четности PID");
+
+#define LIN_ID_INFO(id) {pidOf(id), flagsOf(id)}
+#define LIN_ID_INFO_8(id)                                                            \
+  LIN_ID_INFO(id), LIN_ID_INFO(id + 1), LIN_ID_INFO(id + 2), LIN_ID_INFO(id + 3),    \
+      LIN_ID_INFO(id + 4), LIN_ID_INFO(id + 5), LIN_ID_INFO(id + 6), LIN_ID_INFO(id + 7)
+
+  static const IdInfo kIdTable[kNumIds] PROGMEM = {
+      LIN_ID_INFO_8(0x00), LIN_ID_INFO_8(0x08), LIN_ID_INFO_8(0x10), LIN_ID_INFO_8(0x18),
+      LIN_ID_INFO_8(0x20), LIN_ID_INFO_8(0x28), LIN_ID_INFO_8(0x30), LIN_ID_INFO_8(0x38),
+  };
+
+#undef LIN_ID_INFO_8
+#undef LIN_ID_INFO
+
+  // Модель суммы ID - 4 бита, ID 2n в младших битах байта [n]: тип суммы
+  // (kModelClassic) и уверенность в нем (kModelConfidenceMask, 0 - тип не известен).
+  static const uint8 kModelClassic = 0x8;
+  static const uint8 kModelConfidenceMask = 0x7;
+  static uint8 models[kNumIds / 2];
+
+  static inline uint8 modelOf(uint8 id)
+  {
+    return (id & 1) ? models[id >> 1] >> 4 : models[id >> 1] & 0xf;
+  }
+
+  static inline void setModel(uint8 id, uint8 model)
+  {
+    uint8 &pair = models[id >> 1];
+    pair = (id & 1) ? (uint8)((pair & 0x0f) | (model << 4)) : (uint8)((pair & 0xf0) | model);
+  }
+
+  static inline boolean isModelLearned(uint8 model)
+  {
+    return (model & kModelConfidenceMask) >= kModelConfirmFrames;
+  }
+
+  static inline uint8 flagsOfId(uint8 id)
+  {
+    return pgm_read_byte(&kIdTable[id & 0x3f].flags);
+  }
+
+  uint8 protectedId(uint8 id)
+  {
+    return pgm_read_byte(&kIdTable[id & 0x3f].pid);
+  }
+
+  boolean isValidPid(uint8 pid)
+  {
+    return protectedId(pid) == pid;
+  }
+
+  uint8 checksum(uint8 pid, const uint8 *data, uint8 data_size, boolean enhanced)
+  {
+    uint8 sum = enhanced ? pid : 0;
+    for (uint8 i = 0; i < data_size; i++)
+    {
+      sum = addWithCarry(sum, data[i]);
+    }
+    return (uint8)~sum;
+  }
+
+  boolean usesEnhancedChecksum(uint8 id)
+  {
+    id &= 0x3f;
+    if (flagsOfId(id) & kClassicChecksumOnly)
+    {
+      return false;
+    }
+    const uint8 model = modelOf(id);
+    if (isModelLearned(model))
+    {
+      return !(model & kModelClassic);
+    }
+    return custom_defs::kUseLinChecksumVersion2;
+  }
+
+  boolean acceptChecksum(uint8 id, boolean enhanced_ok, boolean classic_ok)
+  {
+    id &= 0x3f;
+    if (flagsOfId(id) & kClassicChecksumOnly)
+    {
+      return classic_ok;
+    }
+    if (!enhanced_ok && !classic_ok)
+    {
+      return false;
+    }
+    // Для правильного PID суммы двух типов никогда не совпадают, поэтому кадр
+    // совпал ровно с одним типом.
+    const uint8 model = modelOf(id);
+    const boolean learned = isModelLearned(model);
+    const boolean model_ok = (model & kModelClassic) ? classic_ok : enhanced_ok;
+    const uint8 confidence = model & kModelConfidenceMask;
+    if (model_ok)
+    {
+      if (confidence < kModelConfidenceMask)
+      {
+        setModel(id, model + 1);
+      }
+    }
+    else if (confidence > 1)
+    {
+      setModel(id, model - 1);
+    }
+    else
+    {
+      setModel(id, (classic_ok ? kModelClassic : 0) | 1);
+    }
+    return model_ok || !learned;
+  }
+
+  void resetChecksumModels()
+  {
+    // Модели дополняет ISR приема.
+    cli();
+    for (uint8 i = 0; i < sizeof(models); i++)
+    {
+      models[i] = 0;
+    }
+    sei();
+  }
+} // namespace lin_ids
@@ -0,0 +1,57 @@
+#ifndef LIN_IDS_H
+#define LIN_IDS_H
+
+#include "avr_util.h"
+
+// Сведения об ID LIN, общие для приема и передачи: таблица PID и признаков ID во
+// флеш-памяти (считается при компиляции) и модель контрольной суммы каждого ID.
+//
+// В одном кластере бывают узлы LIN 1.x (классическая сумма, только данные) и 2.x
+// (расширенная, PID и данные), а диагностические кадры 0x3C и 0x3D всегда с
+// классической. Поэтому тип суммы определяется по ID: для диагностических он
+// фиксирован, для остальных выучивается по кадрам (см. acceptChecksum()).
+namespace lin_ids
+{
+  static const uint8 kNumIds = 64;
+
+  // PID (ID с битами четности P0, P1) для ID 0..63.
+  extern uint8 protectedId(uint8 id);
+
+  // pid - проводной байт с правильными битами четности.
+  extern boolean isValidPid(uint8 pid);
+
+  // Сложение с переносом из старшего бита в младший, как в контрольной сумме LIN.
+  static inline uint8 addWithCarry(uint8 sum, uint8 value)
+  {
+    const uint16 result = (uint16)sum + value;
+    return (uint8)(result + (result >> 8));
+  }
+
+  // Контрольная сумма LIN. enhanced - расширенная (LIN 2.x, с PID).
+  extern uint8 checksum(uint8 pid, const uint8 *data, uint8 data_size, boolean enhanced);
+
+  // Подряд совпавших с одним типом кадров, после которых тип суммы ID считается
+  // выученным.
+  static const uint8 kModelConfirmFrames = 3;
+
+  // Тип суммы для передачи кадра с этим ID: классическая для 0x3C, 0x3D и ID, для
+  // которых на шине выучена классическая, иначе custom_defs::kUseLinChecksumVersion2.
+  extern boolean usesEnhancedChecksum(uint8 id);
+
+  // Вызывается из ISR приема для кадра с правильным PID. enhanced_ok и
+  // classic_ok - совпала ли его контрольная сумма с каждым из типов. Возвращает
+  // true, если сумма правильная для модели ID.
+  //
+  // Каждый кадр, сумма которого совпала с одним из типов, меняет уверенность в
+  // типе ID: совпадение с ним прибавляет 1 (до 7), с другим типом - отнимает 1, а
+  // с нуля тип меняется на другой. Пока уверенность меньше kModelConfirmFrames,
+  // подходит любой тип; выученный тип требует kModelConfirmFrames совпадений подряд,
+  // и поврежденный кадр, случайно совпавший с другим типом, его не закрепит. Если
+  // тип ID на шине сменился, после нескольких несовпадений он выучивается заново.
+  extern boolean acceptChecksum(uint8 id, boolean enhanced_ok, boolean classic_ok);
+
+  // Забыть выученные типы сумм (другая шина). Вызывается из main.
+  extern void resetChecksumModels();
+} // namespace lin_ids
+
+#endif
@@ -3,7 +3,13 @@
 #include "avr_util.h"
 #include "custom_defs.h"
 #include "hardware_clock.h"
+#include "isr_timing.h"
 #include "lawicel.h"
+#include "lin_ids.h"
+#include "passive_timer.h"
+#include "sio.h"
+#include "stats.h"
+#include "system_clock.h"
 
 // ----- Параметры, связанные со скоростью передачи данных. ---
 
@@ -18,6 +24,37 @@ static const uint16 kDefaultBaud = 9600;
 //
 static const uint8 kMaxSpaceBits = 6;
 
+// Ждать не более N битов конца разрыва и начала байта синхронизации.
+static const uint8 kMaxBreakWaitBits = 16;
+
+// Передача начинается после N высоких битов подряд: больше, чем байт 0xFF со
+// стоповым битом и максимальным пробелом до следующего байта.
+static const uint8 kTxIdleBits = 10 + kMaxSpaceBits;
+
+// Не более стольких ID в таблице ответов подчиненных устройств.
+static const uint8 kMaxResponses = 8;
+
+// ----- Параметры автоопределения скорости. ---
+
+// Стандартные скорости LIN для режима autobaud_modes::STANDARD, по возрастанию.
+// Для них же собраны варианты выборки битов с постоянным периодом бита (Rate<>).
+static constexpr uint16 kStandardBauds[] = {2400, 4800, 9600, 10417, 19200, 20000};
+static const uint8 kNumStandardBauds = sizeof(kStandardBauds) / sizeof(kStandardBauds[0]);
+
+// Скорость во время поиска. Самая высокая: разрыв любой более низкой скорости
+// длиннее 10 ее битов и обнаруживается.
+static const uint16 kAutobaudHuntBaud = 20000;
+
+// Тайм-аут ожидания каждого фронта байта синхронизации, пока скорость не известна.
+// Два бита на самой низкой скорости (1000 бод).
+static const uint16 kAutobaudEdgeTimeoutTicks = 500;
+// То же для конца разрыва и начала байта синхронизации: kMaxBreakWaitBits битов
+// на самой низкой скорости.
+static const uint16 kAutobaudBreakWaitTicks = kMaxBreakWaitBits * kAutobaudEdgeTimeoutTicks;
+
+// Захват теряется, если столько времени не было байта синхронизации.
+static const uint16 kAutobaudLockTimeoutMillis = 2000;
+
 // Определяем входной пин с быстрым доступом. Использование макроса делает
 // не увеличивать время доступа к выводу по сравнению с прямой манипуляцией битами.
 // Пин настроен с активным подтягиванием.
@@ -60,6 +97,33 @@ static const uint8 kMaxSpaceBits = 6;
 namespace lin_processor
 {
 
+  // Параметры Timer2 для скорости baud. Одни и те же формулы считают их для любой
+  // скорости в Config::setup() и на этапе компиляции для стандартных (Rate<>).
+  namespace timing
+  {
+    // Наименьший пределитель, при котором период бита (плюс один отсчет дробной
+    // части) помещается в 8-битный Timer2. Чем больше отсчетов на бит, тем
+    // меньше ошибка выборки.
+    static constexpr uint8 prescaling(uint32 baud)
+    {
+      return baud >= 8000 ? 8 : (baud >= 2000 ? 32 : 64);
+    }
+
+    // Период бита в 1/256 отсчета Timer2. Например, 10417 бод при x8 - 191,99
+    // отсчета, целая часть дала бы ошибку 0,5% на бит.
+    static constexpr uint32 countsPerBitX256(uint32 baud)
+    {
+      return ((16000000L / prescaling(baud)) * 256 + baud / 2) / baud;
+    }
+
+    // Компенсация задержки от фронта стартового бита до setTimerToHalfTick(): вход
+    // в INT0 с прологом, около 32 тактов CPU.
+    static constexpr uint8 countsPerHalfBit(uint32 baud)
+    {
+      return (countsPerBitX256(baud) >> 9) + (32 + prescaling(baud) / 2) / prescaling(baud);
+    }
+  }
+
   class Config
   {
   public:
@@ -67,39 +131,98 @@ namespace lin_processor
 #error "The existing code assumes 16Mhz CPU clk."
 #endif
     // Инициализируется для заданной скорости передачи данных.
-    void setup()
+    void setup(uint32 baud)
     {
       // Если скорость передачи данных вне допустимого диапазона, используйте скорость по умолчанию.
-      uint16 baud = custom_defs::kLinSpeed;
-      if (baud < 1000 || baud > 20000)
+      if (baud < kMinBaud || baud > kMaxBaud)
       {
         baud = kDefaultBaud;
       }
       baud_ = baud;
-      prescaler_x64_ = baud < 8000;
-      const uint8 prescaling = prescaler_x64_ ? 64 : 8;
-      counts_per_bit_ = (((16000000L / prescaling) / baud));
-      // Добавление двух счетчиков для компенсации программной задержки.
-      counts_per_half_bit_ = (counts_per_bit_ / 2) + 2;
+      high_speed_ = baud > kMaxSampledBaud;
+      switch (timing::prescaling(baud))
+      {
+      case 8:
+        prescaler_bits_ = L(CS22) | H(CS21) | L(CS20);
+        half_micros_shift_ = 0;
+        break;
+      case 32:
+        prescaler_bits_ = L(CS22) | H(CS21) | H(CS20);
+        half_micros_shift_ = 2;
+        break;
+      default:
+        prescaler_bits_ = H(CS22) | L(CS21) | L(CS20);
+        half_micros_shift_ = 3;
+      }
+      const uint32 counts_per_bit_x256 = timing::countsPerBitX256(baud);
+      counts_per_bit_ = counts_per_bit_x256 >> 8;
+      counts_fraction_ = counts_per_bit_x256 & 0xff;
+      counts_per_half_bit_ = timing::countsPerHalfBit(baud);
+      // Вариант выборки битов: номер стандартной скорости с 1, 0 - параметры из
+      // config.
+      rate_variant_ = 0;
+      for (uint8 i = 0; i < kNumStandardBauds && !high_speed_; i++)
+      {
+        if (kStandardBauds[i] == baud)
+        {
+          rate_variant_ = i + 1;
+        }
+      }
       clock_ticks_per_bit_ = (hardware_clock::kTicksPerMilli * 1000) / baud;
       clock_ticks_per_half_bit_ = clock_ticks_per_bit_ / 2;
       clock_ticks_per_until_start_bit_ = clock_ticks_per_bit_ * kMaxSpaceBits;
+      clock_ticks_per_break_wait_ = clock_ticks_per_bit_ * kMaxBreakWaitBits;
+
+      // Для декодера по фронтам. Считаем от начала стартового бита без накопления
+      // ошибки округления clock_ticks_per_bit_.
+      const uint32 clock_ticks_per_second = hardware_clock::kTicksPerMilli * 1000;
+      for (uint8 i = 0; i < kBitsPerByte; i++)
+      {
+        clock_ticks_to_bit_center_[i] = ((2 * i + 1) * clock_ticks_per_second + baud) / (2L * baud);
+      }
+      clock_ticks_per_break_ = (kMinBreakBits * clock_ticks_per_second) / baud;
+      clock_ticks_until_frame_end_ = ((kBitsPerByte + kMaxSpaceBits) * clock_ticks_per_second) / baud;
     }
 
-    inline uint16 baud() const
+    inline uint32 baud() const
     {
       return baud_;
     }
 
-    inline boolean prescaler_x64()
+    // Выше kMaxSampledBaud (только LIN_RX_HIGH_SPEED): выборка та же, но только
+    // прием, без передачи и таблицы ответов.
+    inline boolean high_speed() const
+    {
+      return LIN_RX_HIGH_SPEED && high_speed_;
+    }
+
+    // 1 + индекс kStandardBauds, если для скорости собран вариант Rate<>, иначе 0.
+    inline uint8 rate_variant() const
+    {
+      return rate_variant_;
+    }
+
+    // Биты CS22..CS20 пределителя Timer2.
+    inline uint8 prescaler_bits() const
     {
-      return prescaler_x64_;
+      return prescaler_bits_;
+    }
+
+    // Сдвиг влево, переводящий отсчеты Timer2 в 0,5 мкс.
+    inline uint8 half_micros_shift() const
+    {
+      return half_micros_shift_;
     }
 
     inline uint8 counts_per_bit() const
     {
       return counts_per_bit_;
     }
+    // Дробная часть периода бита в 1/256 отсчета.
+    inline uint8 counts_fraction() const
+    {
+      return counts_fraction_;
+    }
     inline uint8 counts_per_half_bit() const
     {
       return counts_per_half_bit_;
@@ -112,27 +235,97 @@ namespace lin_processor
     {
       return clock_ticks_per_half_bit_;
     }
-    inline uint8 clock_ticks_per_until_start_bit() const
+    inline uint16 clock_ticks_per_until_start_bit() const
     {
       return clock_ticks_per_until_start_bit_;
     }
+    inline uint16 clock_ticks_per_break_wait() const
+    {
+      return clock_ticks_per_break_wait_;
+    }
+    // Середина бита bit_index [0, kBitsPerByte) от начала стартового бита.
+    inline uint16 clock_ticks_to_bit_center(uint8 bit_index) const
+    {
+      return clock_ticks_to_bit_center_[bit_index];
+    }
+    // Минимальная длительность низкого уровня, считающаяся разрывом.
+    inline uint16 clock_ticks_per_break() const
+    {
+      return clock_ticks_per_break_;
+    }
+    // От начала стартового бита до конца кадра, если следующий байт не начался.
+    inline uint16 clock_ticks_until_frame_end() const
+    {
+      return clock_ticks_until_frame_end_;
+    }
+
+    // Стартовый бит, 8 бит данных, стоповый бит.
+    static const uint8 kBitsPerByte = 10;
+    // Разрыв по стандарту не короче 13 бит. Принимаем от 11, как и большинство
+    // приемников LIN.
+    static const uint8 kMinBreakBits = 11;
 
   private:
-    uint16 baud_;
-    // Ложь -> x8, истина -> x64.
-    // TODO: timer2 также имеет масштабирование x32l Мог бы использовать его получше
-    // точность в среднем диапазоне бодов.
-    boolean prescaler_x64_;
+    uint32 baud_;
+    boolean high_speed_;
+    uint8 rate_variant_;
+    // x8, x32 или x64.
+    uint8 prescaler_bits_;
+    uint8 half_micros_shift_;
     uint8 counts_per_bit_;
+    uint8 counts_fraction_;
     uint8 counts_per_half_bit_;
     uint8 clock_ticks_per_bit_;
     uint8 clock_ticks_per_half_bit_;
-    uint8 clock_ticks_per_until_start_bit_;
+    // 16 бит: при скорости ниже ~3200 бод kMaxSpaceBits битов не помещаются в 8 бит.
+    uint16 clock_ticks_per_until_start_bit_;
+    uint16 clock_ticks_per_break_wait_;
+    uint16 clock_ticks_to_bit_center_[kBitsPerByte];
+    uint16 clock_ticks_per_break_;
+    uint16 clock_ticks_until_frame_end_;
   };
 
-  // Фактическая конфигурация. Инициализируется в setup() на основе скорости передачи данных.
+  // Фактическая конфигурация. Инициализируется в setup() на основе скорости передачи данных
+  // и заменяется из main с отключенными прерываниями при смене скорости.
   Config config;
 
+  // Период бита Timer2 стандартной скорости kBaud (целые отсчеты и дробная часть) -
+  // константы: в ISR это непосредственные операнды вместо чтения config из SRAM, а
+  // при целом числе отсчетов на бит (20000 бод) накопление дробной части исчезает
+  // совсем. Только они: половину бита (setTimerToHalfTick()) пишет INT0, где
+  // вариант не выбран, а ожидание следующего стартового бита (waitNextByte()) -
+  // общий для всех вариантов handleStopBit(); оба берутся из config.
+  template <uint16 kBaud>
+  struct Rate
+  {
+    static_assert(kBaud >= kMinBaud && kBaud <= kMaxSampledBaud, "Rate<> только для выборки по Timer2");
+
+    static inline uint8 counts_per_bit()
+    {
+      return timing::countsPerBitX256(kBaud) >> 8;
+    }
+    static inline uint8 counts_fraction()
+    {
+      return timing::countsPerBitX256(kBaud) & 0xff;
+    }
+  };
+
+  // То же для любой скорости: параметры из config.
+  struct RuntimeRate
+  {
+    static inline uint8 counts_per_bit()
+    {
+      return config.counts_per_bit();
+    }
+    static inline uint8 counts_fraction()
+    {
+      return config.counts_fraction();
+    }
+  };
+
+  // Скорость без автоопределения: custom_defs::kLinSpeed или заданная setBaud().
+  static uint32 selected_baud = custom_defs::kLinSpeed;
+
   // ----- Контакты цифрового ввода/вывода
   //
   // ПРИМЕЧАНИЕ: мы используем прямой доступ к регистру вместо абстракций в io_pins.h.
@@ -141,7 +334,8 @@ namespace lin_processor
   // ЛИН-интерфейс.
   DEFINE_INPUT_PIN(rx_pin, D, 2);
   DEFINE_OUTPUT_PIN(virtual_vcc_rx_pin, D, 6, 1);
-  // DEFINE_OUTPUT_PIN(tx_pin, D, 3, 1);
+  // TX трансивера (D12). Покой - высокий (рецессивный) уровень.
+  DEFINE_OUTPUT_PIN(tx_pin, B, 4, 1);
   DEFINE_OUTPUT_PIN(sleep_pin, D, 4, 1);
 
   // Индикация подключения.
@@ -151,94 +345,125 @@ namespace lin_processor
   static inline void setupPins()
   {
     virtual_vcc_rx_pin::setup();
+    tx_pin::setup();
     Connected_led_pin::setup();
     sleep_pin::setup();
   }
 
-  // ----- Кольцевые буферы ISR RX -----
+  // ----- Кольцевой буфер кадров RX -----
+  //
+  // Кадры хранятся подряд записями переменной длины (LinFrame::recordSize(): байт
+  // сведений, метка времени, байты кадра), поэтому короткие кадры занимают мало
+  // места. Запись - начало объекта LinFrame, и обе стороны работают с ней прямо в
+  // буфере: ISR собирает кадр на месте следующей записи, main читает его через
+  // peekFrame().
+  //
+  // Запись начинается только там, где до конца буфера помещается целый LinFrame,
+  // иначе с нуля, поэтому записи никогда не переходят через конец буфера. Место
+  // под собираемый кадр (sizeof(LinFrame) байтов от head) всегда свободно; если
+  // после кадра для следующего места нет, кадр отбрасывается.
+  //
+  // Очередь с одним производителем (ISR) и одним потребителем (main) без запрета
+  // прерываний. head_frame_offset пишет только ISR, tail_frame_offset - только
+  // main; оба однобайтовые, поэтому читаются и пишутся атомарно.
 
-  // Размер очереди буфера кадра.
-  static const uint8 kMaxFrameBuffers = 8;
+  static_assert(kFrameRingSize >= 2 * sizeof(LinFrame), "Буфер кадров меньше двух кадров");
 
-  // Очередь буферов RX Frame. Чтение/запись только ISR.
-  static LinFrame rx_frame_buffers[kMaxFrameBuffers];
+  static uint8 frame_ring[kFrameRingSize];
 
-  // Индекс [0, kMaxFrameBuffers) текущего буфера кадра
-  // написано (самое новое). Чтение/запись только ISR.
-  static uint8 head_frame_buffer;
+  // Смещение записи, которую собирает ISR. Пишется только ISR.
+  static volatile uint8 head_frame_offset;
 
-  // Индекс [0, kMaxFrameBuffers) следующего считываемого кадра (самого старого).
-  // Если равно head_frame_buffer, то доступного фрейма нет.
-  // Чтение/запись только ISR.
-  static uint8 tail_frame_buffer;
+  // Смещение самой старой готовой записи. Если равно head_frame_offset, готовых
+  // кадров нет. Пишется только main.
+  static volatile uint8 tail_frame_offset;
 
-  // Вызывается один раз из main.
+  // Вызывается один раз из main до разрешения прерываний.
   static inline void setupBuffers()
   {
-    head_frame_buffer = 0;
-    tail_frame_buffer = 0;
+    head_frame_offset = 0;
+    tail_frame_offset = 0;
   }
 
-  // Вызывается из ISR или из main с отключенными прерываниями.
-  static inline void incrementTailFrameBuffer()
+  static inline LinFrame &frameAt(uint8 offset)
   {
-    if (++tail_frame_buffer >= kMaxFrameBuffers)
-    {
-      tail_frame_buffer = 0;
-    }
+    return *reinterpret_cast<LinFrame *>(&frame_ring[offset]);
   }
 
-  // Вызывается из ISR. Если вы наступаете на хвостовой буфер, вызывающая сторона должна
-  // приращение поднять ошибку переполнения кадра.
-  static inline void incrementHeadFrameBuffer()
+  // Кадр, который собирает ISR.
+  static inline LinFrame &headFrame()
   {
-    if (++head_frame_buffer >= kMaxFrameBuffers)
-    {
-      head_frame_buffer = 0;
-    }
+    return frameAt(head_frame_offset);
+  }
+
+  // Смещение записи, следующей за записью размера record_size.
+  static inline uint8 nextFrameOffset(uint8 offset, uint8 record_size)
+  {
+    offset += record_size;
+    return (offset > kFrameRingSize - sizeof(LinFrame)) ? 0 : offset;
   }
 
-  // ----- ISR для основной передачи данных -----
+  // ----- Фильтр приема по ID -----
 
-  // Увеличение на ISR, чтобы указать основной программе, когда ISR возвращается.
-  // Это используется для отложенного отключения прерываний до тех пор, пока ISR не завершится до
-  // уменьшить время джиттера ISR.
-  static volatile uint8 isr_marker;
+  // Бит (id & 7) байта accepted_ids[id >> 3] разрешает кадры с этим ID. Читается ISR,
+  // пишется из main с отключенными прерываниями.
+  static uint8 accepted_ids[8] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
 
-  // Должен вызываться только из main.
-  static inline void waitForIsrEnd()
+  // Вызывается из ISR. pid - байт идентификатора с битами четности.
+  static inline boolean isIdAccepted(uint8 pid)
   {
-    const uint8 value = isr_marker;
-    // Подождите, пока не завершится следующая ISR.
-    while (value == isr_marker)
-    {
-    }
+    const uint8 id = pid & 0x3f;
+    return accepted_ids[id >> 3] & bitMask(id & 7);
   }
 
   // Общедоступно. Вызывается из основного. См. описание в .h.
-  boolean readNextFrame(LinFrame *buffer)
+  void setIdFilter(const uint8 bitmap[8])
   {
-    boolean result = false;
-    waitForIsrEnd();
     cli();
-    if (tail_frame_buffer != head_frame_buffer)
+    for (uint8 i = 0; i < sizeof(accepted_ids); i++)
     {
-      // Это копирует структуру буфера запроса.
-      *buffer = rx_frame_buffers[tail_frame_buffer];
-      incrementTailFrameBuffer();
-      result = true;
+      accepted_ids[i] = bitmap[i];
     }
     sei();
-    return result;
+  }
+
+  // ----- Чтение кадров из main -----
+
+  // Общедоступно. Вызывается из основного. См. описание в .h.
+  boolean frameAvailable()
+  {
+    const boolean available = tail_frame_offset != head_frame_offset;
+    // Кадр читается только после индекса, который его опубликовал.
+    COMPILER_BARRIER();
+    return available;
+  }
+
+  // Общедоступно. Вызывается из основного. См. описание в .h.
+  const LinFrame &peekFrame()
+  {
+    return frameAt(tail_frame_offset);
+  }
+
+  // Общедоступно. Вызывается из основного. См. описание в .h.
+  void commitFrame()
+  {
+    // Кадр дочитан до того, как буфер вернется ISR.
+    COMPILER_BARRIER();
+    const uint8 tail = tail_frame_offset;
+    tail_frame_offset = nextFrameOffset(tail, frameAt(tail).recordSize());
   }
 
   // ----- Декларация конечного автомата -----
 
+#if !LIN_RX_EDGE_DECODER
   // То же, что enum, но только 8 бит.
   namespace states
   {
     static const uint8 DETECT_BREAK = 1;
     static const uint8 READ_DATA = 2;
+    static const uint8 TRANSMIT = 3;
+    // Ожидание фронта RX (StateWaitEdge).
+    static const uint8 WAIT_EDGE = 4;
   }
   static uint8 state;
 
@@ -246,20 +471,84 @@ namespace lin_processor
   {
   public:
     static inline void enter();
+    // Последний байт кадра оказался 0x00 с низким стоповым битом: это первые 10
+    // битов разрыва следующего кадра. Ждем его конца.
+    static inline void continueBreak();
     static inline void handleIsr();
+    // Вызывается на переднем фронте в конце разрыва.
+    static inline void handleBreakEnd(uint16 ticks);
 
   private:
     static uint8 low_bits_counter_;
+    // Высокие выборки подряд, до kTxIdleBits. Передача начинается только на
+    // свободной шине.
+    static uint8 high_bits_counter_;
+    // Время первой низкой выборки. Снимается только при автоопределении скорости.
+    static uint16 break_start_ticks_;
+  };
+
+  // Ожидание фронта RX без цикла в ISR. Фронт ловит INT0, тики Timer2 в это время
+  // только проверяют тайм-аут. Середина стартового бита отсчитывается от фронта,
+  // как раньше от выхода из цикла опроса вывода, но прерывания не запрещены на
+  // время паузы между байтами.
+  class StateWaitEdge
+  {
+  public:
+    // Чего ждем.
+    // Передний фронт в конце разрыва. Без тайм-аута.
+    static const uint8 kBreakEnd = 1;
+    // Стартовый бит байта синхронизации.
+    static const uint8 kSyncStart = 2;
+    // Следующий задний фронт байта синхронизации при автоопределении скорости.
+    static const uint8 kSyncEdge = 3;
+    // Стартовый бит следующего байта кадра.
+    static const uint8 kByteStart = 4;
+
+    // Ждать фронта target до момента hardware_clock deadline_ticks.
+    static inline void enter(uint8 target, uint16 deadline_ticks);
+    // Вызывается из INT0.
+    static inline void handleEdgeIsr();
+    // Вызывается на тике Timer2.
+    static inline void handleIsr();
+    // Запретить INT0.
+    static inline void disarm();
+    // Фронт уже произошел, и INT0 вызовется сразу после текущего ISR.
+    static inline boolean isEdgePending();
+
+  private:
+    static uint8 target_;
+    static uint16 deadline_ticks_;
   };
 
   class StateReadData
   {
   public:
-    // Должен вызываться после обнаружения стопового бита прерывания.
-    static inline void enter();
+    // Вызывается в конце разрыва, ticks - его время. Байт синхронизации начнется по
+    // INT0.
+    static inline void enter(uint16 ticks);
+    // Вызывается после передачи своего заголовка: ответ подчиненного устройства
+    // читается как продолжение кадра с этим PID.
+    static inline void enterResponse(uint8 pid, uint16 timestamp_ticks);
+    // Выборка бита. R - параметры скорости, Rate<> или RuntimeRate (см.
+    // handleReadDataIsr()).
+    template <class R>
     static inline void handleIsr();
+    // Фронты StateWaitEdge. ticks - время фронта.
+    static inline void startSync(uint16 ticks);
+    static inline void addSyncEdge(uint16 ticks);
+    static inline void startByte();
+    // Следующий байт не начался за kMaxSpaceBits: кадр закончен.
+    static inline void endFrame();
 
   private:
+    // Выборка стопового бита: байт собран. Реже остальных и длиннее, поэтому одна
+    // копия на все варианты handleIsr().
+    static void handleStopBit(uint8 is_rx_high);
+    static inline void waitNextByte();
+
+    // Сколько задних фронтов байта синхронизации осталось измерить.
+    static uint8 sync_edges_left_;
+
     // Количество полных байтов, прочитанных на данный момент. Включает все байты, даже
     // синхронизация, идентификатор и контрольная сумма.
     static uint8 bytes_read_;
@@ -276,6 +565,61 @@ namespace lin_processor
     // отменить вычисление ISR.
     static uint8 byte_buffer_bit_mask_;
   };
+#else
+  // Декодер по фронтам. Каждый фронт RX вызывает INT0, время фронта берется из
+  // hardware_clock (4 мкс). Бит получает уровень, который был на линии в его
+  // середине, отсчитанной от фронта стартового бита. Байт завершается по
+  // совпадению Timer1 A в середине стопового бита, тот же канал отмеряет
+  // паузу конца кадра. ISR вызываются только на фронтах и раз в байт, а не на
+  // каждом бите, и никогда не ждут в цикле.
+  class EdgeDecoder
+  {
+  public:
+    static void setup();
+    // Вернуться к ожиданию разрыва. Вызывается из main с отключенными прерываниями.
+    static void reset();
+    static inline void handleEdgeIsr();
+    static inline void handleTimeoutIsr();
+    // Шина свободна для передачи: кадра нет и фронтов не было дольше паузы конца
+    // кадра. Вызывается из ISR.
+    static inline boolean isIdle();
+    // Передача прервана ошибкой бита: кадр, начатый нашим разрывом, не
+    // буферизуется. Вызывается из ISR.
+    static inline void dropTransmittedFrame();
+
+  private:
+    static inline void startByte(uint16 ticks);
+    static inline void sampleUntil(uint16 ticks);
+    static inline void finishByte();
+    static inline void handleByte(uint8 value);
+    static inline void startFrame();
+    static inline void abortFrame(uint8 flags);
+    static inline void endFrame();
+    static inline void armTimeout(uint16 ticks);
+    static inline void disarmTimeout();
+
+    // То же, что enum, но только 8 бит.
+    static const uint8 kIdle = 1;
+    static const uint8 kInByte = 2;
+    static const uint8 kInLowLevel = 3;
+    static uint8 state_;
+
+    // Был разрыв, и байты добавляются в текущий кадр. Байт синхронизации
+    // проверяется, но не добавляется.
+    static boolean in_frame_;
+    static uint8 bytes_read_;
+
+    // Уровень RX после последнего фронта (0 - низкий).
+    static uint8 level_;
+    // Время фронта стартового бита текущего байта.
+    static uint16 byte_start_ticks_;
+    // Уровни в серединах битов, младший бит - стартовый. bit_mask_ указывает
+    // на следующий бит, которому еще не назначен уровень.
+    static uint16 bits_;
+    static uint16 bit_mask_;
+    static uint8 bit_index_;
+  };
+#endif
 
   // ----- Флаг ошибки. -----
 
@@ -287,6 +631,7 @@ namespace lin_processor
   {
     // Неатомарно при вызове из setup(), но должно быть нормально, так как ISR еще не запущен.
     error_flags |= flags;
+    stats::countErrors(flags);
   }
 
   // Вызывается из основного. Общественный. Предполагается, что прерывания разрешены.
@@ -302,6 +647,95 @@ namespace lin_processor
     return result;
   }
 
+  // ----- Автоопределение скорости (часть ISR) -----
+
+  // Режим, autobaud_modes. Пишется из main с отключенными прерываниями.
+  static uint8 autobaud_mode;
+
+  // Истина, пока скорость не захвачена: кадры только измеряются, но не декодируются.
+  // Пишется из main с отключенными прерываниями.
+  static boolean baud_hunting;
+
+  // Задние фронты байта синхронизации 0x55: начало стартового бита и битов данных
+  // 1, 3, 5, 7. Соседние фронты отстоят на 2 бита, первый и последний - на 8.
+  static const uint8 kSyncFallingEdges = 5;
+  static uint16 sync_edge_ticks[kSyncFallingEdges];
+  // Число снятых фронтов. kSyncFallingEdges - измерение не идет.
+  static uint8 sync_edges = kSyncFallingEdges;
+  // Длительность низкого уровня разрыва перед байтом синхронизации.
+  static uint16 sync_break_ticks;
+  // Истина, когда измерение завершено и еще не прочитано main.
+  static volatile boolean sync_measured;
+
+  // Вызывается из ISR в конце разрыва.
+  static inline void startSyncMeasurement(uint16 break_ticks)
+  {
+    // Пока скорость приема выше скорости шины, низкий бит байта синхронизации может
+    // выглядеть как разрыв. Он намного короче настоящего разрыва и измерение не
+    // прерывает.
+    if (sync_edges < kSyncFallingEdges && break_ticks < (sync_break_ticks >> 1))
+    {
+      return;
+    }
+    sync_measured = false;
+    sync_break_ticks = break_ticks;
+    sync_edges = 0;
+  }
+
+  // Вызывается из ISR на заднем фронте RX. Вне измерения ничего не делает.
+  static inline void addSyncFallingEdge(uint16 ticks)
+  {
+    if (sync_edges < kSyncFallingEdges)
+    {
+      sync_edge_ticks[sync_edges] = ticks;
+      if (++sync_edges == kSyncFallingEdges)
+      {
+        sync_measured = true;
+      }
+    }
+  }
+
+  // Вызывается из ISR. Переходит к следующему кадру в кольцевом буфере, статус
+  // кадра уже записан.
+  static inline void pushHeadFrameBuffer()
+  {
+    // Пока кадр ждет в очереди, 16-битные часы могут пройти полный круг.
+    headFrame().set_timestamp_ticks(system_clock::extendTicksForIsr((uint16)headFrame().timestamp_ticks()));
+    stats::countFrame(headFrame());
+    const uint8 next = nextFrameOffset(head_frame_offset, headFrame().recordSize());
+    // Место следующего кадра не должно задевать непрочитанные записи. Записи
+    // между tail и next, только если next не дальше tail.
+    const uint8 tail = tail_frame_offset;
+    stats::updateFrameQueueUsage(next > tail ? next - tail : kFrameRingSize - tail + next);
+    if (next <= tail && (uint8)(tail - next) < sizeof(LinFrame))
+    {
+      // Очередь заполнена, main не успевает. Кадр отбрасывается, на его месте
+      // собирается следующий.
+      setErrorFlags(errors::BUFFER_OVERRUN);
+      return;
+    }
+    // Кадр записан до публикации смещения.
+    COMPILER_BARRIER();
+    head_frame_offset = next;
+  }
+
+  // Вызывается из ISR по окончании кадра. Длина, четность PID и контрольная сумма
+  // проверяются здесь (LinFrame::validate()), main получает кадр со статусом.
+  static inline void commitHeadFrameBuffer()
+  {
+    headFrame().validate();
+    pushHeadFrameBuffer();
+  }
+
+  // Вызывается из ISR, когда в кадре больше LinFrame::kMaxBytes байтов. Кадр
+  // буферизуется усеченным со статусом LinFrame::kStatusTooLong.
+  static inline void commitTooLongFrame()
+  {
+    setErrorFlags(errors::FRAME_TOO_LONG);
+    headFrame().set_status(LinFrame::kStatusTooLong);
+    pushHeadFrameBuffer();
+  }
+
   struct BitName
   {
     const uint8 mask;
@@ -316,160 +750,851 @@ namespace lin_processor
       {errors::SYNC_BYTE, "SYNC"},
       {errors::BUFFER_OVERRUN, "OVRN"},
       {errors::OTHER, "OTHR"},
+      {errors::BIT_ERROR, "BIT"},
   };
 
-  // ----- Инициализация -----
+  // ----- Тики битов Timer2 -----
 
-  static void setupTimer()
+  // Накопленная дробная часть периода бита в текущем байте, 1/256 отсчета.
+  // Чтение/запись только ISR.
+  static uint8 bit_phase;
+
+  // Вызывается из ISR на каждом бите байта. Когда накопленная дробная часть
+  // переполняется, следующий период на один отсчет длиннее, поэтому середины битов
+  // отстают от точных не больше чем на один отсчет до конца байта. R - Rate<> или
+  // RuntimeRate.
+  template <class R = RuntimeRate>
+  static inline void advanceBitPeriod()
   {
-    // Режим быстрой ШИМ, выход OC2B активен на высоком уровне.
-    TCCR2A = L(COM2A1) | L(COM2A0) | H(COM2B1) | H(COM2B0) | H(WGM21) | H(WGM20);
-    const uint8 prescaler = config.prescaler_x64() ? (H(CS22) | L(CS21) | L(CS20)) : (L(CS22) | H(CS21) | L(CS20)); // x64 // x8
-    // Пределитель: X8. Должен соответствовать определению kPreScaler;
-    TCCR2B = L(FOC2A) | L(FOC2B) | H(WGM22) | prescaler;
-    
-    // Очистить счетчик.
-    TCNT2 = 0;
-    // Определяет скорость передачи данных.
-    OCR2A = config.counts_per_bit() - 1;
-    // Короткий 8-тактовый импульс на OC2B в конце каждого цикла,
-    // непосредственно перед запуском ISR.
-    OCR2B = config.counts_per_bit() - 2;
-    // Прерывание при совпадении A.
-    TIMSK2 = L(OCIE2B) | H(OCIE2A) | L(TOIE2);
-    // Очистить ожидающие прерывания сравнения A.
-    TIFR2 = L(OCF2B) | H(OCF2A) | L(TOV2);
-    
+    const uint8 phase = bit_phase + R::counts_fraction();
+    const uint8 top = (phase < bit_phase) ? R::counts_per_bit() : R::counts_per_bit() - 1;
+    OCR2A = top;
+    isr_timing::timer2TopWritten(top);
+    bit_phase = phase;
   }
 
-  // Вызываем один раз из main в начале программы.
-  void setup()
+  // Установите значение таймера на половину тика. Вызывается в начале
+  // стартовый бит для генерации тиков выборки в середине следующего
+  // 10 бит (старт, 8 * данные, стоп).
+  static inline void setTimerToHalfTick()
   {
-    // Это следует сделать в первую очередь, так как от этого зависят некоторые из приведенных ниже шагов.
-    config.setup();
+    // counts_per_half_bit() включает компенсацию задержки перед вызовом. Цель
+    // чтобы следующая выборка данных ISR была в середине старта
+    // кусочек.
+    GTCCR = H(PSRASY);
+    TCNT2 = config.counts_per_half_bit();
+    OCR2A = config.counts_per_bit() - 1;
+    // Текущий период досчитает до прежнего TOP.
+    isr_timing::timer2TopWritten(config.counts_per_bit() - 1);
+    bit_phase = 0;
+  }
 
-    setupPins();
-    setupBuffers();
-    StateDetectBreak::enter();
-    setupTimer();
-    error_flags = 0;
-    virtual_vcc_rx_pin::setHigh();
-    sleep_pin::setHigh();
+  // ----- Передатчик -----
+  //
+  // Кадр выводится на tx_pin по тикам Timer2: при LIN_RX_EDGE_DECODER == 0 это те же
+  // тики битов, по которым идет прием, при LIN_RX_EDGE_DECODER == 1 Timer2 включается
+  // только на время передачи. Разрыв - 13 тиков низкого уровня и тик разделителя,
+  // затем байты. main только кладет кадр в буфер и сразу возвращается, ISR начинает
+  // передачу, когда шина свободна. Прерывания не запрещаются.
+  //
+  // На каждом тике, перед выводом следующего бита, RX сравнивается с предыдущим
+  // битом: к концу бита уровень шины уже установился. Доминантный уровень
+  // другого узла во время нашего рецессивного бита - ошибка бита LIN.
+
+  // То же, что enum, но только 8 бит. Результат Transmitter::handleTick().
+  namespace tx_results
+  {
+    static const uint8 MORE = 0;
+    static const uint8 DONE = 1;
+    static const uint8 BIT_ERROR = 2;
   }
 
-  void loop()
+  class Transmitter
   {
-    if (lawicel::isConnected == true)
+  public:
+    // Вызывается из main. bytes - PID, данные и контрольная сумма, без байта
+    // синхронизации. Возвращает false, если предыдущий кадр еще не передан.
+    static boolean start(const uint8 *bytes, uint8 num_bytes);
+    // Вызывается из main с отключенными прерываниями. Прервать передачу.
+    static void reset();
+
+    // Кадр ожидает передачи или передается.
+    static inline boolean isBusy()
     {
-      Connected_led_pin::setHigh();
+      return busy_;
     }
-    else
+    static inline boolean isActive()
     {
-      Connected_led_pin::setLow();
+      return active_;
+    }
+    // Вызывается из ISR. Начать передачу ожидающего кадра с текущего тика.
+    static inline void begin();
+    // Вызывается из ISR. Начать передачу ответа подчиненного устройства (данные и
+    // контрольная сумма) со следующего тика. Ожидающий кадр остается в очереди.
+    static inline void beginResponse(const uint8 *data, uint8 data_size, uint8 checksum);
+    // Вызывается из ISR на каждом тике передачи. Возвращает tx_results: DONE, когда
+    // передан стоповый бит последнего байта, BIT_ERROR, когда передача прервана.
+    static inline uint8 handleTick();
+    // Вызывается из ISR после DONE. Записать переданный кадр (PID, данные,
+    // контрольная сумма) в frame для буфера приема.
+    static inline void copyFrame(LinFrame &frame);
+    // То же для ответа: добавить переданные байты ответа к кадру с PID.
+    static inline void appendResponse(LinFrame &frame);
+    static inline boolean isResponse()
+    {
+      return is_response_;
+    }
+
+    // Только заголовок: ответ передает подчиненное устройство.
+    static inline boolean isHeaderOnly()
+    {
+      return num_bytes_ == 2;
+    }
+    static inline uint8 pid()
+    {
+      return buffer_[1];
+    }
+    // Время начала байта синхронизации, как у принятых кадров.
+    static inline uint16 timestamp_ticks()
+    {
+      return timestamp_ticks_;
+    }
+
+  private:
+    static const uint8 kBreakBits = 13;
+    // Синхронизация, PID, до 8 байт данных, контрольная сумма.
+    static const uint8 kMaxBytes = 1 + LinFrame::kMaxBytes;
+
+    // Истина от start() до конца передачи. Устанавливается main, сбрасывается ISR.
+    static volatile boolean busy_;
+    static boolean active_;
+    static uint8 buffer_[kMaxBytes];
+    static uint8 num_bytes_;
+    // Данные и контрольная сумма ответа. Копия записи таблицы: main может менять
+    // таблицу во время передачи.
+    static uint8 response_[LinFrame::kMaxBytes - 1];
+    static uint8 response_size_;
+
+    // Передаваемые байты: buffer_ или response_.
+    static boolean is_response_;
+    static const uint8 *bytes_;
+    static uint8 size_;
+    static uint8 byte_index_;
+    // Оставшиеся биты текущего байта (или разрыва), младший выводится следующим.
+    static uint16 shift_;
+    static uint8 bits_left_;
+    // Ожидаемое значение rx_pin::isHigh() для последнего выведенного бита, с ним
+    // сравнивается RX на следующем тике.
+    static uint8 expected_rx_;
+    static uint16 timestamp_ticks_;
+  };
+
+  volatile boolean Transmitter::busy_;
+  boolean Transmitter::active_;
+  uint8 Transmitter::buffer_[Transmitter::kMaxBytes];
+  uint8 Transmitter::num_bytes_;
+  uint8 Transmitter::response_[LinFrame::kMaxBytes - 1];
+  uint8 Transmitter::response_size_;
+  boolean Transmitter::is_response_;
+  const uint8 *Transmitter::bytes_;
+  uint8 Transmitter::size_;
+  uint8 Transmitter::byte_index_;
+  uint16 Transmitter::shift_;
+  uint8 Transmitter::bits_left_;
+  uint8 Transmitter::expected_rx_;
+  uint16 Transmitter::timestamp_ticks_;
+
+  boolean Transmitter::start(const uint8 *bytes, uint8 num_bytes)
+  {
+    if (busy_ || num_bytes < 1 || num_bytes > LinFrame::kMaxBytes)
+    {
+      return false;
+    }
+    buffer_[0] = 0x55;
+    for (uint8 i = 0; i < num_bytes; i++)
+    {
+      buffer_[i + 1] = bytes[i];
     }
+    // cli() также не дает компилятору переставить запись буфера после busy_.
+    cli();
+    num_bytes_ = num_bytes + 1;
+    busy_ = true;
+    sei();
+    return true;
   }
-  // ----- Вспомогательные функции ISR -----
 
-  // Установить значение таймера на ноль.
-  static inline void resetTickTimer()
+  void Transmitter::reset()
   {
-    // TODO: также очистить предварительный делитель timer2.
-    TCNT2 = 0;
+    busy_ = false;
+    active_ = false;
+    tx_pin::setHigh();
   }
 
-  // Установите значение таймера на половину тика. Вызывается в начале
-  // стартовый бит для генерации тиков выборки в середине следующего
-  // 10 бит (старт, 8 * данные, стоп).
-  static inline void setTimerToHalfTick()
+  inline void Transmitter::begin()
   {
-    // Добавляем 2, чтобы компенсировать задержку перед вызовом. Цель
-    // чтобы следующая выборка данных ISR была в середине старта
-    // кусочек.
-    TCNT2 = config.counts_per_half_bit();
+    active_ = true;
+    is_response_ = false;
+    bytes_ = buffer_;
+    size_ = num_bytes_;
+    byte_index_ = 0;
+    // 13 нулевых битов разрыва и единичный разделитель.
+    shift_ = H(kBreakBits);
+    bits_left_ = kBreakBits + 1;
+    // Передача начинается на свободной (высокой) шине.
+    expected_rx_ = rx_pin::kPinMask;
+    bit_phase = 0;
   }
 
-  // Выполняем плотный цикл занятости до тех пор, пока RX не станет низким или заданное число
-  // пройдено тактов часов (тайм-аут). Возвращает true, если все в порядке,
-  // ложь, если тайм-аут. Сохраняет сброс таймера во время ожидания.
-  // Вызывается только из ISR.
-  static inline boolean waitForRxLow(uint16 max_clock_ticks)
+  inline void Transmitter::beginResponse(const uint8 *data, uint8 data_size, uint8 checksum)
   {
-    const uint16 base_clock = hardware_clock::ticksForIsr();
-    for (;;)
+    for (uint8 i = 0; i < data_size; i++)
     {
-      // Держите тиковый таймер не тикающим (нет ISR).
-      resetTickTimer();
-
-      // Если rx низкий, мы закончили.
-      if (!rx_pin::isHigh())
-      {
-        return true;
-      }
+      response_[i] = data[i];
+    }
+    response_[data_size] = checksum;
+    response_size_ = data_size + 1;
+    active_ = true;
+    is_response_ = true;
+    bytes_ = response_;
+    size_ = data_size + 1;
+    byte_index_ = 0;
+    // Первый тик - конец стопового бита PID или пробел после него.
+    bits_left_ = 0;
+    expected_rx_ = rx_pin::kPinMask;
+  }
 
-      // Проверка тайм-аута.
-      // Должно работать также в случае переполнения 16-битных часов.
-      const uint16 clock_diff = hardware_clock::ticksForIsr() - base_clock;
-      if (clock_diff >= max_clock_ticks)
+  inline uint8 Transmitter::handleTick()
+  {
+    if (rx_pin::isHigh() != expected_rx_)
+    {
+      tx_pin::setHigh();
+      active_ = false;
+      if (!is_response_)
       {
-        return false;
+        busy_ = false;
       }
+      setErrorFlags(errors::BIT_ERROR);
+      return tx_results::BIT_ERROR;
     }
-  }
 
-  // То же, что и waitForRxLow, но с обратной полярностью.
-  // Мы клонируем код для оптимизации времени.
-  // Вызывается только из ISR.
-  static inline boolean waitForRxHigh(uint16 max_clock_ticks)
-  {
-    const uint16 base_clock = hardware_clock::ticksForIsr();
-    for (;;)
+    if (!bits_left_)
     {
-      resetTickTimer();
-      if (rx_pin::isHigh())
+      if (byte_index_ == size_)
       {
-        return true;
+        active_ = false;
+        if (!is_response_)
+        {
+          busy_ = false;
+        }
+        return tx_results::DONE;
       }
-      // Должно работать и в случае переполнения часов.
-      const uint16 clock_diff = hardware_clock::ticksForIsr() - base_clock;
-      if (clock_diff >= max_clock_ticks)
+      if (byte_index_ == 0 && !is_response_)
       {
-        return false;
+        timestamp_ticks_ = hardware_clock::ticksForIsr();
       }
+      // Стартовый бит 0, 8 бит данных младшим вперед, стоповый бит 1.
+      shift_ = ((uint16)bytes_[byte_index_++] << 1) | H(9);
+      bits_left_ = 10;
+    }
+    if (shift_ & 1)
+    {
+      tx_pin::setHigh();
+      expected_rx_ = rx_pin::kPinMask;
+    }
+    else
+    {
+      tx_pin::setLow();
+      expected_rx_ = 0;
     }
+    shift_ >>= 1;
+    bits_left_--;
+    advanceBitPeriod();
+    return tx_results::MORE;
   }
 
-  // ----- Реализация состояния обнаружения-разрыва -----
-
-  uint8 StateDetectBreak::low_bits_counter_;
-
-  inline void StateDetectBreak::enter()
+  inline void Transmitter::copyFrame(LinFrame &frame)
   {
-    state = states::DETECT_BREAK;
-    low_bits_counter_ = 0;
+    frame.reset();
+    frame.set_transmitted(true);
+    frame.set_timestamp_ticks(timestamp_ticks_);
+    // Без байта синхронизации.
+    for (uint8 i = 1; i < num_bytes_; i++)
+    {
+      frame.append_byte(buffer_[i]);
+    }
   }
 
-  // Возвращаем true, если достаточно времени для обслуживания запроса rx.
-  inline void StateDetectBreak::handleIsr()
+  inline void Transmitter::appendResponse(LinFrame &frame)
   {
-    if (rx_pin::isHigh())
+    for (uint8 i = 0; i < response_size_; i++)
     {
-      low_bits_counter_ = 0;
-      return;
+      frame.append_byte(response_[i]);
     }
+  }
 
-    // Здесь RX низкий (активный)
-
-    if (++low_bits_counter_ < 10)
-    {
-      return;
-    }
+  // ----- Таблица ответов -----
+  //
+  // Эмуляция подчиненных устройств. Ответ на заголовок с PID из таблицы
+  // передается прямо из ISR приема после стопового бита PID, без участия main и
+  // хоста. Ответ передается и на свои заголовки, и для ID, не прошедших фильтр
+  // приема. Кадр с ответом попадает в буфер приема с LinFrame::transmitted().
 
-    // TODO: установить фактическое максимальное количество
-    waitForRxHigh(255);
+  struct Response
+  {
+    // Проводной PID: заголовок с неверной четностью не совпадает ни с одной записью.
+    uint8 pid;
+    uint8 data_size;
+    uint8 data[8];
+    // Суммы обоих типов считаются при записи в таблицу, а выбирается при передаче
+    // (lin_ids::usesEnhancedChecksum()): модель ID может выучиться и позже.
+    uint8 enhanced_checksum;
+    uint8 classic_checksum;
+  };
 
-    // Идем обрабатывать данные
-    StateReadData::enter();
-  }
+  // Занятые записи всегда в начале массива. Читается ISR, пишется из main с
+  // отключенными прерываниями.
+  static Response responses[kMaxResponses];
+  static uint8 num_responses;
+
+  // Вызывается из ISR после стопового бита PID. Возвращает true, если ответ начат.
+  static inline boolean startResponse(uint8 pid)
+  {
+    // Шина занята нашим кадром: PID наш, ответ тоже. Выше kMaxSampledBaud
+    // передачи нет (см. transmitFrame()).
+    if (Transmitter::isActive() || config.high_speed())
+    {
+      return false;
+    }
+    for (uint8 i = 0; i < num_responses; i++)
+    {
+      if (responses[i].pid == pid)
+      {
+        const Response &response = responses[i];
+        Transmitter::beginResponse(response.data, response.data_size,
+                                   lin_ids::usesEnhancedChecksum(pid) ? response.enhanced_checksum
+                                                                      : response.classic_checksum);
+#if LIN_RX_EDGE_DECODER
+        // Timer2 свободен: первый тик через половину бита, в конце стопового бита.
+        setTimerToHalfTick();
+        TIFR2 = H(OCF2A);
+        TIMSK2 |= H(OCIE2A);
+#endif
+        return true;
+      }
+    }
+    return false;
+  }
+
+  static Response *findResponse(uint8 pid)
+  {
+    for (uint8 i = 0; i < num_responses; i++)
+    {
+      if (responses[i].pid == pid)
+      {
+        return &responses[i];
+      }
+    }
+    return NULL;
+  }
+
+  // Общедоступно. Вызывается из основного. См. описание в .h.
+  boolean setResponse(uint8 id, const uint8 *data, uint8 data_size)
+  {
+    if (data_size < 1 || data_size > 8)
+    {
+      return false;
+    }
+    Response entry;
+    entry.pid = lin_ids::protectedId(id);
+    entry.data_size = data_size;
+    for (uint8 i = 0; i < data_size; i++)
+    {
+      entry.data[i] = data[i];
+    }
+    entry.enhanced_checksum = lin_ids::checksum(entry.pid, data, data_size, true);
+    entry.classic_checksum = lin_ids::checksum(entry.pid, data, data_size, false);
+
+    Response *slot = findResponse(entry.pid);
+    if (!slot)
+    {
+      if (num_responses >= kMaxResponses)
+      {
+        return false;
+      }
+      slot = &responses[num_responses];
+    }
+    // Запись заменяется целиком между двумя ISR: ответ никогда не смешивает
+    // старые и новые данные.
+    cli();
+    *slot = entry;
+    if (slot == &responses[num_responses])
+    {
+      num_responses++;
+    }
+    sei();
+    return true;
+  }
+
+  boolean removeResponse(uint8 id)
+  {
+    Response *slot = findResponse(lin_ids::protectedId(id));
+    if (!slot)
+    {
+      return false;
+    }
+    // Последняя запись занимает место удаленной.
+    cli();
+    *slot = responses[--num_responses];
+    sei();
+    return true;
+  }
+
+  void clearResponses()
+  {
+    cli();
+    num_responses = 0;
+    sei();
+  }
+
+  // ----- Инициализация -----
+
+  static void setupTimer()
+  {
+    // Режим быстрой ШИМ, выход OC2B активен на высоком уровне.
+    TCCR2A = L(COM2A1) | L(COM2A0) | H(COM2B1) | H(COM2B0) | H(WGM21) | H(WGM20);
+    TCCR2B = L(FOC2A) | L(FOC2B) | H(WGM22) | config.prescaler_bits();
+    
+    // Очистить счетчик.
+    TCNT2 = 0;
+    // Определяет скорость передачи данных.
+    OCR2A = config.counts_per_bit() - 1;
+    isr_timing::timer2Restarted(config.counts_per_bit() - 1);
+    // Короткий 8-тактовый импульс на OC2B в конце каждого цикла,
+    // непосредственно перед запуском ISR.
+    OCR2B = config.counts_per_bit() - 2;
+    // Прерывание при совпадении A. Декодеру по фронтам Timer2 нужен только на
+    // время передачи.
+#if LIN_RX_EDGE_DECODER
+    TIMSK2 = L(OCIE2B) | L(OCIE2A) | L(TOIE2);
+#else
+    TIMSK2 = L(OCIE2B) | H(OCIE2A) | L(TOIE2);
+#endif
+    // Очистить ожидающие прерывания сравнения A.
+    TIFR2 = L(OCF2B) | H(OCF2A) | L(TOV2);
+    
+  }
+
+  // Вызываем один раз из main в начале программы.
+  void setup()
+  {
+    // Это следует сделать в первую очередь, так как от этого зависят некоторые из приведенных ниже шагов.
+    config.setup(selected_baud);
+
+    setupPins();
+    setupBuffers();
+#if LIN_RX_EDGE_DECODER
+    EdgeDecoder::setup();
+#else
+    StateDetectBreak::enter();
+#endif
+    setupTimer();
+    error_flags = 0;
+    virtual_vcc_rx_pin::setHigh();
+    sleep_pin::setHigh();
+  }
+
+  // ----- Автоопределение скорости (часть main) -----
+
+  // Переключить прием на новую скорость. Текущий кадр теряется.
+  static void applyBaud(uint32 baud)
+  {
+    // Расчет с делениями занимает сотни микросекунд, поэтому делаем его до cli().
+    Config new_config;
+    new_config.setup(baud);
+    cli();
+    config = new_config;
+    Transmitter::reset();
+#if LIN_RX_EDGE_DECODER
+    EdgeDecoder::reset();
+#else
+    StateDetectBreak::enter();
+#endif
+    setupTimer();
+    sei();
+  }
+
+  // Скорость захвачена (или захват потерян) и не сообщена main.
+  static boolean baud_lock_changed;
+  // Отсчитывает время с последнего байта синхронизации на захваченной скорости.
+  static PassiveTimer baud_lock_timer;
+
+  // Переход в поиск или захват. Скорость baud применяется, если отличается от текущей.
+  static void setBaudHunting(boolean hunting, uint16 baud)
+  {
+    if (baud != config.baud())
+    {
+      applyBaud(baud);
+    }
+    cli();
+    baud_hunting = hunting;
+    sei();
+    baud_lock_changed = true;
+    baud_lock_timer.restart();
+  }
+
+  // Скорость по фронтам байта синхронизации или 0, если измерение не похоже на
+  // разрыв и байт синхронизации.
+  static uint16 syncBaud(const uint16 edge_ticks[kSyncFallingEdges], uint16 break_ticks)
+  {
+    const uint16 total_ticks = edge_ticks[kSyncFallingEdges - 1] - edge_ticks[0];
+    if (total_ticks == 0)
+    {
+      return 0;
+    }
+    // Каждый интервал в 2 бита должен быть в пределах 1/8 от четверти общего.
+    for (uint8 i = 1; i < kSyncFallingEdges; i++)
+    {
+      const int16 deviation = 4 * (edge_ticks[i] - edge_ticks[i - 1]) - total_ticks;
+      const int16 max_deviation = total_ticks >> 3;
+      if (deviation > max_deviation || deviation < -max_deviation)
+      {
+        return 0;
+      }
+    }
+    const uint32 clock_ticks_per_second = hardware_clock::kTicksPerMilli * 1000L;
+    uint32 baud = (8 * clock_ticks_per_second + total_ticks / 2) / total_ticks;
+    // Немного выше 20000, чтобы 20000 бод с дрожанием фронтов не отбрасывались.
+    if (baud < 1000 || baud > 22000)
+    {
+      return 0;
+    }
+    if (baud > 20000)
+    {
+      baud = 20000;
+    }
+    // Низкий уровень перед байтом синхронизации должен быть разрывом на измеренной
+    // скорости, а не, например, байтом 0x00 на более низкой.
+    if ((uint32)break_ticks * baud < Config::kMinBreakBits * clock_ticks_per_second)
+    {
+      return 0;
+    }
+    return baud;
+  }
+
+  // Ближайшая стандартная скорость по отношению скоростей.
+  static uint16 nearestStandardBaud(uint16 baud)
+  {
+    uint8 i = 0;
+    // Граница между соседними скоростями - их среднее геометрическое. Сравниваем
+    // baud^2 с произведением соседей.
+    while (i + 1 < kNumStandardBauds &&
+           (uint32)baud * baud > (uint32)kStandardBauds[i] * kStandardBauds[i + 1])
+    {
+      i++;
+    }
+    return kStandardBauds[i];
+  }
+
+  // Вызывается из loop().
+  static void autobaudLoop()
+  {
+    if (autobaud_mode == autobaud_modes::OFF)
+    {
+      return;
+    }
+
+    if (sync_measured)
+    {
+      uint16 edge_ticks[kSyncFallingEdges];
+      cli();
+      for (uint8 i = 0; i < kSyncFallingEdges; i++)
+      {
+        edge_ticks[i] = sync_edge_ticks[i];
+      }
+      const uint16 break_ticks = sync_break_ticks;
+      sync_measured = false;
+      sei();
+
+      uint16 baud = syncBaud(edge_ticks, break_ticks);
+      if (baud)
+      {
+        if (autobaud_mode == autobaud_modes::STANDARD)
+        {
+          baud = nearestStandardBaud(baud);
+        }
+        // Точную скорость не перенастраиваем из-за дрожания измерения в пределах 1/64.
+        const uint32 current = config.baud();
+        const uint32 diff = baud > current ? baud - current : current - baud;
+        if (baud_hunting || diff > (current >> 6))
+        {
+          setBaudHunting(false, baud);
+        }
+        baud_lock_timer.restart();
+      }
+    }
+
+    if (!baud_hunting && baud_lock_timer.timeMillis() > kAutobaudLockTimeoutMillis)
+    {
+      setBaudHunting(true, kAutobaudHuntBaud);
+    }
+  }
+
+  // Общедоступно. Вызывается из основного. См. описание в .h.
+  void setAutobaudMode(uint8 mode)
+  {
+    // Другая скорость - скорее всего, другая шина.
+    lin_ids::resetChecksumModels();
+    cli();
+    autobaud_mode = mode;
+    sei();
+    if (mode == autobaud_modes::OFF)
+    {
+      cli();
+      baud_hunting = false;
+      sei();
+      if (config.baud() != selected_baud)
+      {
+        applyBaud(selected_baud);
+      }
+      return;
+    }
+    setBaudHunting(true, kAutobaudHuntBaud);
+    // О начале поиска не сообщаем, только о захвате.
+    baud_lock_changed = false;
+  }
+
+  void setBaud(uint32 baud)
+  {
+    selected_baud = baud;
+    setAutobaudMode(autobaud_modes::OFF);
+  }
+
+  uint32 baud()
+  {
+    return config.baud();
+  }
+
+  boolean getAndClearBaudLockChange(uint16 *locked_baud)
+  {
+    if (!baud_lock_changed)
+    {
+      return false;
+    }
+    baud_lock_changed = false;
+    // При автоопределении скорость не выше kAutobaudHuntBaud.
+    *locked_baud = baud_hunting ? 0 : (uint16)config.baud();
+    return true;
+  }
+
+  boolean transmitFrame(const uint8 *bytes, uint8 num_bytes)
+  {
+    // Пока скорость не захвачена, передавать не на чем. Передача выше
+    // kMaxSampledBaud на стенде не проверялась.
+    if (baud_hunting || config.high_speed() || !Transmitter::start(bytes, num_bytes))
+    {
+      return false;
+    }
+#if LIN_RX_EDGE_DECODER
+    // Тики Timer2 нужны только до конца передачи, их выключает ISR.
+    cli();
+    TIFR2 = H(OCF2A);
+    TIMSK2 |= H(OCIE2A);
+    sei();
+#endif
+    return true;
+  }
+
+  boolean isTransmitting()
+  {
+    return Transmitter::isBusy();
+  }
+
+  void loop()
+  {
+    if (lawicel::isConnected == true)
+    {
+      Connected_led_pin::setHigh();
+    }
+    else
+    {
+      Connected_led_pin::setLow();
+    }
+    autobaudLoop();
+  }
+
+#if !LIN_RX_EDGE_DECODER
+  // ----- Вспомогательные функции ISR -----
+
+  // Тайм-аут ожидания конца разрыва и начала байта синхронизации. При автоопределении
+  // разрыв может быть на любой скорости.
+  static inline uint16 breakWaitTicks()
+  {
+    return autobaud_mode != autobaud_modes::OFF ? kAutobaudBreakWaitTicks : config.clock_ticks_per_break_wait();
+  }
+
+  // ----- Реализация состояния ожидания фронта -----
+
+  uint8 StateWaitEdge::target_;
+  uint16 StateWaitEdge::deadline_ticks_;
+
+  inline void StateWaitEdge::enter(uint8 target, uint16 deadline_ticks)
+  {
+    state = states::WAIT_EDGE;
+    target_ = target;
+    deadline_ticks_ = deadline_ticks;
+    // Флаг INT0 взводится фронтами и при запрещенном INT0, поэтому сбрасывается
+    // после смены фронта. Вызывается из ISR, так что ложный флаг не успеет сработать.
+    EICRA = L(ISC11) | L(ISC10) | H(ISC01) | ((target == kBreakEnd) ? H(ISC00) : L(ISC00));
+    EIFR = H(INTF0);
+    EIMSK = L(INT1) | H(INT0);
+  }
+
+  inline void StateWaitEdge::disarm()
+  {
+    EIMSK = L(INT1) | L(INT0);
+  }
+
+  inline boolean StateWaitEdge::isEdgePending()
+  {
+    return EIFR & H(INTF0);
+  }
+
+  inline void StateWaitEdge::handleEdgeIsr()
+  {
+    // Выборки идут от фронта стартового бита (или начала низкого уровня), поэтому
+    // таймер перезапускается первым. Совпадение, взведенное до фронта, уже не нужно.
+    if (target_ == kSyncStart || target_ == kByteStart)
+    {
+      setTimerToHalfTick();
+      TIFR2 = H(OCF2A);
+    }
+    const uint16 ticks = hardware_clock::ticksForIsr();
+    disarm();
+    switch (target_)
+    {
+    case kBreakEnd:
+      StateDetectBreak::handleBreakEnd(ticks);
+      return;
+    case kSyncStart:
+      StateReadData::startSync(ticks);
+      return;
+    case kSyncEdge:
+      StateReadData::addSyncEdge(ticks);
+      return;
+    default:
+      StateReadData::startByte();
+    }
+  }
+
+  inline void StateWaitEdge::handleIsr()
+  {
+    // Фронт обработает INT0 сразу после этого ISR.
+    if (isEdgePending())
+    {
+      return;
+    }
+    if (target_ == kBreakEnd)
+    {
+      // Линия могла подняться до того, как INT0 был разрешен.
+      if (rx_pin::isHigh())
+      {
+        handleEdgeIsr();
+      }
+      return;
+    }
+    // Должно работать и в случае переполнения часов.
+    if ((int16)(hardware_clock::ticksForIsr() - deadline_ticks_) < 0)
+    {
+      return;
+    }
+    disarm();
+    switch (target_)
+    {
+    case kByteStart:
+      StateReadData::endFrame();
+      return;
+    default:
+      // При поиске скорости ошибки байта синхронизации ожидаемы.
+      if (!baud_hunting)
+      {
+        setErrorFlags(errors::SYNC_BYTE);
+      }
+      StateDetectBreak::enter();
+    }
+  }
+
+  // ----- Реализация состояния обнаружения-разрыва -----
+
+  uint8 StateDetectBreak::low_bits_counter_;
+  uint8 StateDetectBreak::high_bits_counter_;
+  uint16 StateDetectBreak::break_start_ticks_;
+
+  inline void StateDetectBreak::enter()
+  {
+    state = states::DETECT_BREAK;
+    low_bits_counter_ = 0;
+    high_bits_counter_ = 0;
+    StateWaitEdge::disarm();
+  }
+
+  // Вызывается в середине низкого стопового бита.
+  inline void StateDetectBreak::continueBreak()
+  {
+    if (autobaud_mode != autobaud_modes::OFF)
+    {
+      break_start_ticks_ = hardware_clock::ticksForIsr() - config.clock_ticks_to_bit_center(Config::kBitsPerByte - 1);
+    }
+    StateWaitEdge::enter(StateWaitEdge::kBreakEnd, 0);
+  }
+
+  // Возвращаем true, если достаточно времени для обслуживания запроса rx.
+  inline void StateDetectBreak::handleIsr()
+  {
+    if (rx_pin::isHigh())
+    {
+      low_bits_counter_ = 0;
+      if (high_bits_counter_ < kTxIdleBits)
+      {
+        high_bits_counter_++;
+        return;
+      }
+      // Шина свободна. Передача ожидающего кадра начинается с этого тика.
+      if (Transmitter::isBusy())
+      {
+        state = states::TRANSMIT;
+        Transmitter::begin();
+        Transmitter::handleTick();
+      }
+      return;
+    }
+
+    high_bits_counter_ = 0;
+
+    // Здесь RX низкий (активный)
+
+    if (++low_bits_counter_ < 10)
+    {
+      if (low_bits_counter_ == 1 && autobaud_mode != autobaud_modes::OFF)
+      {
+        break_start_ticks_ = hardware_clock::ticksForIsr();
+      }
+      return;
+    }
+
+    // Конец разрыва ловит INT0.
+    StateWaitEdge::enter(StateWaitEdge::kBreakEnd, 0);
+  }
+
+  inline void StateDetectBreak::handleBreakEnd(uint16 ticks)
+  {
+    if (autobaud_mode != autobaud_modes::OFF)
+    {
+      startSyncMeasurement(ticks - break_start_ticks_);
+    }
+
+    // Идем обрабатывать данные
+    StateReadData::enter(ticks);
+  }
 
   // ----- Реализация состояния чтения данных -----
 
@@ -477,25 +1602,119 @@ namespace lin_processor
   uint8 StateReadData::bits_read_in_byte_;
   uint8 StateReadData::byte_buffer_;
   uint8 StateReadData::byte_buffer_bit_mask_;
+  uint8 StateReadData::sync_edges_left_;
 
   // Вызывается при переходе от низкого уровня к высокому в конце разрыва.
-  inline void StateReadData::enter()
+  inline void StateReadData::enter(uint16 ticks)
   {
-    state = states::READ_DATA;
     bytes_read_ = 0;
     bits_read_in_byte_ = 0;
-    rx_frame_buffers[head_frame_buffer].reset();
+    headFrame().reset();
+    StateWaitEdge::enter(StateWaitEdge::kSyncStart, ticks + breakWaitTicks());
+  }
+
+  // Фронт стартового бита байта синхронизации, таймер уже на половине бита.
+  inline void StateReadData::startSync(uint16 ticks)
+  {
+    // Метка времени кадра: начало стартового бита байта синхронизации.
+    headFrame().set_timestamp_ticks(ticks);
+    if (autobaud_mode == autobaud_modes::OFF)
+    {
+      state = states::READ_DATA;
+      return;
+    }
+
+    // При автоопределении скорости байт синхронизации не выбирается по битам, а
+    // измеряется по задним фронтам, затем чтение продолжается с байта
+    // идентификатора. Скорость может быть еще неверной, поэтому тайм-ауты фронтов
+    // рассчитаны на самую низкую скорость.
+    addSyncFallingEdge(ticks);
+    sync_edges_left_ = kSyncFallingEdges - 1;
+    StateWaitEdge::enter(StateWaitEdge::kSyncEdge, ticks + 2 * kAutobaudEdgeTimeoutTicks);
+  }
+
+  inline void StateReadData::addSyncEdge(uint16 ticks)
+  {
+    addSyncFallingEdge(ticks);
+    if (--sync_edges_left_)
+    {
+      StateWaitEdge::enter(StateWaitEdge::kSyncEdge, ticks + 2 * kAutobaudEdgeTimeoutTicks);
+      return;
+    }
+
+    // При поиске кадр только измеряется.
+    if (baud_hunting)
+    {
+      StateDetectBreak::enter();
+      return;
+    }
+
+    // Бит 7 байта синхронизации низкий, затем стоповый бит и стартовый бит
+    // идентификатора.
+    bytes_read_ = 1;
+    StateWaitEdge::enter(StateWaitEdge::kByteStart,
+                         ticks + 2 * config.clock_ticks_per_bit() + config.clock_ticks_per_until_start_bit());
+  }
+
+  // Фронт стартового бита следующего байта, таймер уже на половине бита.
+  inline void StateReadData::startByte()
+  {
+    // Лишний байт после максимального количества читается целиком: 0x00 с низким
+    // стоповым битом - разрыв следующего кадра, а не ошибка.
+    state = states::READ_DATA;
+  }
+
+  inline void StateReadData::endFrame()
+  {
+    // Проверить минимальное количество байтов. После байта синхронизации без
+    // идентификатора кадр пуст.
+    if (headFrame().num_bytes() < LinFrame::kMinBytes)
+    {
+      setErrorFlags(errors::FRAME_TOO_SHORT);
+      StateDetectBreak::enter();
+      return;
+    }
 
-    // TODO: обработать ошибки тайм-аута после перерыва.
-    // TODO: установить разумный срок.
-    waitForRxLow(255);
-    setTimerToHalfTick();
+    // Кадр пока выглядит нормально.
+    // ПРИМЕЧАНИЕ: мы сбросим byte_count нового буфера кадра в следующий раз, когда войдем в состояние обнаружения данных.
+    commitHeadFrameBuffer();
+    StateDetectBreak::enter();
+  }
+
+  inline void StateReadData::enterResponse(uint8 pid, uint16 timestamp_ticks)
+  {
+    LinFrame &frame = headFrame();
+    frame.reset();
+    frame.set_transmitted(true);
+    frame.set_timestamp_ticks(timestamp_ticks);
+    // Свой заголовок с ID, не прошедшим фильтр, не буферизуется, как и чужой.
+    const boolean accepted = isIdAccepted(pid);
+    if (accepted)
+    {
+      frame.append_byte(pid);
+    }
+    if (startResponse(pid))
+    {
+      state = states::TRANSMIT;
+      return;
+    }
+    if (!accepted)
+    {
+      StateDetectBreak::enter();
+      return;
+    }
+    state = states::READ_DATA;
+    bytes_read_ = 2;
+    bits_read_in_byte_ = 0;
+    waitNextByte();
   }
 
+  template <class R>
   inline void StateReadData::handleIsr()
   {
     // Выборка бита данных как можно скорее, чтобы избежать джиттера.
     const uint8 is_rx_high = rx_pin::isHigh();
+    advanceBitPeriod<R>();
 
     // Обработка стартового бита.
     if (bits_read_in_byte_ == 0)
@@ -529,13 +1748,25 @@ namespace lin_processor
       return;
     }
 
-    // Здесь, когда в стоповом бите.
+    handleStopBit(is_rx_high);
+  }
+
+  void StateReadData::handleStopBit(uint8 is_rx_high)
+  {
     bytes_read_++;
     bits_read_in_byte_ = 0;
 
     // Ошибка, если стоповый бит не высокий.
     if (!is_rx_high)
     {
+      // Кроме 0x00 после идентификатора: 10 низких битов подряд - разрыв следующего
+      // кадра, начавшийся сразу после последнего байта этого (загрузка шины 100%).
+      if (byte_buffer_ == 0 && bytes_read_ > 2)
+      {
+        endFrame();
+        StateDetectBreak::continueBreak();
+        return;
+      }
       // Если в байте синхронизации, сообщить об ошибке синхронизации.
       setErrorFlags(bytes_read_ == 0 ? errors::SYNC_BYTE : errors::STOP_BIT);
       StateDetectBreak::enter();
@@ -558,62 +1789,93 @@ namespace lin_processor
     }
     else
     {
-      // Если это байты идентификатора, данных или контрольной суммы, добавьте их в буфер кадра.
-      // ПРИМЕЧАНИЕ: количество байтов принудительно установлено где-то в другом месте, поэтому здесь мы можем с уверенностью предположить, что это
-      // не приведет к переполнению буфера.
-      rx_frame_buffers[head_frame_buffer].append_byte(byte_buffer_);
-    }
-
-    // Ждем перехода от старшего к младшему начального бита следующего байта.
-    const boolean has_more_bytes = waitForRxLow(config.clock_ticks_per_until_start_bit());
-
-    // Обрабатываем случай, когда в этом фрейме больше нет байтов.
-    if (!has_more_bytes)
-    {
-      // Проверить минимальное количество байтов.
-      if (bytes_read_ < LinFrame::kMinBytes)
+      // Ошибка, если у нас уже было максимальное количество байт.
+      if (headFrame().num_bytes() >= LinFrame::kMaxBytes)
       {
-        setErrorFlags(errors::FRAME_TOO_SHORT);
+        commitTooLongFrame();
         StateDetectBreak::enter();
         return;
       }
 
-      // Кадр пока выглядит нормально. Переход к следующему кадру в кольцевом буфере.
-      // ПРИМЕЧАНИЕ: мы сбросим byte_count нового буфера кадра в следующий раз, когда войдем в состояние обнаружения данных.
-      // ПРИМЕЧАНИЕ: проверка байта синхронизации, идентификатора, контрольной суммы и т. д. выполняется позже основным кодом, а не ISR.
-      incrementHeadFrameBuffer();
-      if (tail_frame_buffer == head_frame_buffer)
+      const boolean accepted = bytes_read_ != 2 || isIdAccepted(byte_buffer_);
+
+      // Если это байты идентификатора, данных или контрольной суммы, добавьте их в буфер кадра.
+      // Количество байтов проверено выше, переполнения буфера нет.
+      if (accepted)
       {
-        // Буфер кадра переполнен. Отбрасываем самый старый кадр и продолжаем с этим.
-        setErrorFlags(errors::BUFFER_OVERRUN);
-        incrementTailFrameBuffer();
+        headFrame().append_byte(byte_buffer_);
       }
 
-      StateDetectBreak::enter();
-      return;
+      // PID из таблицы ответов: отвечаем сами.
+      if (bytes_read_ == 2 && startResponse(byte_buffer_))
+      {
+        headFrame().set_transmitted(true);
+        state = states::TRANSMIT;
+        return;
+      }
+
+      // Кадр с ID, не прошедшим фильтр приема, не буферизуется. Ответ пропускаем
+      // в состоянии обнаружения разрыва: байт данных не дает 10 низких битов подряд.
+      if (!accepted)
+      {
+        StateDetectBreak::enter();
+        return;
+      }
     }
 
-    // Здесь, когда в этом фрейме есть хотя бы еще один байт. Ошибка, если у нас уже было
-    // максимальное количество байт.
-    if (rx_frame_buffers[head_frame_buffer].num_bytes() >= LinFrame::kMaxBytes)
+    waitNextByte();
+  }
+
+  // Вызывается после стопового бита байта, когда bytes_read_ уже учитывает его.
+  inline void StateReadData::waitNextByte()
+  {
+    // Ждем перехода от старшего к младшему начального бита следующего байта.
+    StateWaitEdge::enter(StateWaitEdge::kByteStart,
+                         hardware_clock::ticksForIsr() + config.clock_ticks_per_until_start_bit());
+    // После своего заголовка ответ может начаться раньше, чем разрешен INT0.
+    if (!rx_pin::isHigh() && !StateWaitEdge::isEdgePending())
     {
-      setErrorFlags(errors::FRAME_TOO_LONG);
-      StateDetectBreak::enter();
-      return;
+      StateWaitEdge::handleEdgeIsr();
     }
-
-    // Все готово для следующего байта. Поставьте галочку посередине
-    // стартовый бит.
-    //
-    // TODO: переместите это выше проверки num_bytes выше для большей точности
-    // синхронизация среднего бита?
-    setTimerToHalfTick();
   }
 
   // ----- Обработчик ISR -----
 
+  // Выборка бита в варианте для текущей скорости. Плотный switch собирается в
+  // таблицу переходов; вызов через указатель на функцию заставил бы ISR сохранять
+  // все регистры, которые может затереть вызов. Фронт стартового бита в INT0
+  // (setTimerToHalfTick()) читает config: выбор варианта до записи TCNT2 сдвинул бы
+  // выборки дальше, чем экономит.
+  static inline void handleReadDataIsr()
+  {
+    static_assert(kNumStandardBauds == 6, "Вариант выборки на каждую стандартную скорость");
+    switch (config.rate_variant())
+    {
+    case 1:
+      StateReadData::handleIsr<Rate<kStandardBauds[0]> >();
+      return;
+    case 2:
+      StateReadData::handleIsr<Rate<kStandardBauds[1]> >();
+      return;
+    case 3:
+      StateReadData::handleIsr<Rate<kStandardBauds[2]> >();
+      return;
+    case 4:
+      StateReadData::handleIsr<Rate<kStandardBauds[3]> >();
+      return;
+    case 5:
+      StateReadData::handleIsr<Rate<kStandardBauds[4]> >();
+      return;
+    case 6:
+      StateReadData::handleIsr<Rate<kStandardBauds[5]> >();
+      return;
+    default:
+      StateReadData::handleIsr<RuntimeRate>();
+    }
+  }
+
   // Прерывание по таймеру 2 A-match.
-  ISR(TIMER2_COMPA_vect)
+  static inline void handleTimer2Isr()
   {
     // TODO: сделать это состояние логическим вместо перечисления? (эффективность).
     switch (state)
@@ -622,16 +1884,395 @@ namespace lin_processor
       StateDetectBreak::handleIsr();
       break;
     case states::READ_DATA:
-      StateReadData::handleIsr();
+      handleReadDataIsr();
+      break;
+    case states::WAIT_EDGE:
+      StateWaitEdge::handleIsr();
+      break;
+    case states::TRANSMIT:
+      switch (Transmitter::handleTick())
+      {
+      case tx_results::MORE:
+        break;
+      case tx_results::DONE:
+        // Стоповый бит последнего байта передан и прочитан. После заголовка читаем
+        // ответ, полный кадр или ответ из таблицы сразу идет в буфер приема.
+        if (Transmitter::isResponse())
+        {
+          // Пустой буфер - ID не прошел фильтр.
+          LinFrame &frame = headFrame();
+          if (frame.num_bytes())
+          {
+            Transmitter::appendResponse(frame);
+            commitHeadFrameBuffer();
+          }
+        }
+        else if (Transmitter::isHeaderOnly())
+        {
+          StateReadData::enterResponse(Transmitter::pid(), Transmitter::timestamp_ticks());
+          break;
+        }
+        else if (isIdAccepted(Transmitter::pid()))
+        {
+          Transmitter::copyFrame(headFrame());
+          commitHeadFrameBuffer();
+        }
+        StateDetectBreak::enter();
+        break;
+      default:
+        StateDetectBreak::enter();
+      }
       break;
     default:
       // setErrorFlags(errors::OTHER);
       StateDetectBreak::enter();
     }
+  }
+
+  // Фронт RX (PD2). Разрешено только в состоянии WAIT_EDGE.
+  ISR(INT0_vect)
+  {
+    StateWaitEdge::handleEdgeIsr();
+  }
+
+#else
+  // ----- Реализация декодера по фронтам -----
+
+  uint8 EdgeDecoder::state_;
+  boolean EdgeDecoder::in_frame_;
+  uint8 EdgeDecoder::bytes_read_;
+  uint8 EdgeDecoder::level_;
+  uint16 EdgeDecoder::byte_start_ticks_;
+  uint16 EdgeDecoder::bits_;
+  uint16 EdgeDecoder::bit_mask_;
+  uint8 EdgeDecoder::bit_index_;
+
+  void EdgeDecoder::setup()
+  {
+    rx_pin::setup();
+    reset();
+    // INT0 на любом изменении уровня PD2.
+    EICRA = L(ISC11) | L(ISC10) | L(ISC01) | H(ISC00);
+    EIFR = H(INTF0);
+    EIMSK = L(INT1) | H(INT0);
+  }
+
+  void EdgeDecoder::reset()
+  {
+    state_ = kIdle;
+    in_frame_ = false;
+    level_ = rx_pin::isHigh();
+    disarmTimeout();
+  }
+
+  inline boolean EdgeDecoder::isIdle()
+  {
+    // byte_start_ticks_ - последний задний фронт. После ~260 мс тишины разность
+    // переполняется, и передача может задержаться не больше чем на паузу.
+    return state_ == kIdle && level_ && !in_frame_ &&
+           (uint16)(hardware_clock::ticksForIsr() - byte_start_ticks_) >= config.clock_ticks_until_frame_end();
+  }
+
+  // Время совпадения задается абсолютным значением hardware_clock. Должно быть в
+  // будущем менее чем на ~260 мс.
+  inline void EdgeDecoder::armTimeout(uint16 ticks)
+  {
+    OCR1A = ticks;
+    TIFR1 = H(OCF1A);
+    TIMSK1 |= H(OCIE1A);
+  }
+
+  inline void EdgeDecoder::disarmTimeout()
+  {
+    TIMSK1 &= ~H(OCIE1A);
+  }
+
+  // Вызывается на фронте стартового бита.
+  inline void EdgeDecoder::startByte(uint16 ticks)
+  {
+    state_ = kInByte;
+    byte_start_ticks_ = ticks;
+    bits_ = 0;
+    bit_mask_ = 1;
+    bit_index_ = 0;
+    armTimeout(ticks + config.clock_ticks_to_bit_center(Config::kBitsPerByte - 1));
+  }
+
+  // Назначить текущий уровень всем битам, середина которых прошла к моменту ticks.
+  // Не более kBitsPerByte итераций на байт в сумме.
+  inline void EdgeDecoder::sampleUntil(uint16 ticks)
+  {
+    const uint16 elapsed = ticks - byte_start_ticks_;
+    while (bit_index_ < Config::kBitsPerByte && elapsed >= config.clock_ticks_to_bit_center(bit_index_))
+    {
+      if (level_)
+      {
+        bits_ |= bit_mask_;
+      }
+      bit_mask_ <<= 1;
+      bit_index_++;
+    }
+  }
+
+  // Вызывается при разрыве.
+  inline void EdgeDecoder::startFrame()
+  {
+    // Разрыв пришел раньше тайм-аута конца предыдущего кадра.
+    if (in_frame_)
+    {
+      endFrame();
+    }
+    // При поиске скорости кадр только измеряется.
+    in_frame_ = !baud_hunting;
+    bytes_read_ = 0;
+    headFrame().reset();
+    // Разрыв закончился разделителем нашей передачи.
+    headFrame().set_transmitted(Transmitter::isActive());
+  }
+
+  inline void EdgeDecoder::dropTransmittedFrame()
+  {
+    if (in_frame_ && headFrame().transmitted())
+    {
+      in_frame_ = false;
+    }
+  }
+
+  inline void EdgeDecoder::abortFrame(uint8 flags)
+  {
+    setErrorFlags(flags);
+    in_frame_ = false;
+  }
+
+  inline void EdgeDecoder::endFrame()
+  {
+    in_frame_ = false;
+    if (headFrame().num_bytes() < LinFrame::kMinBytes)
+    {
+      setErrorFlags(errors::FRAME_TOO_SHORT);
+      return;
+    }
+    commitHeadFrameBuffer();
+  }
+
+  // Байт с правильными стартовым и стоповым битами.
+  inline void EdgeDecoder::handleByte(uint8 value)
+  {
+    // Байты вне кадра (без разрыва) игнорируются.
+    if (!in_frame_)
+    {
+      return;
+    }
+
+    // Байт синхронизации должен быть ровно 0x55. Мы не добавляем его в буфер.
+    if (bytes_read_++ == 0)
+    {
+      if (value != 0x55)
+      {
+        abortFrame(errors::SYNC_BYTE);
+        return;
+      }
+      // Метка времени кадра: фронт стартового бита байта синхронизации, уже снятый
+      // в startByte().
+      headFrame().set_timestamp_ticks(byte_start_ticks_);
+      return;
+    }
+
+    // PID из таблицы ответов: отвечаем сами, байты ответа придут через INT0.
+    if (bytes_read_ == 2 && startResponse(value))
+    {
+      headFrame().set_transmitted(true);
+    }
+
+    // Кадр с ID, не прошедшим фильтр приема, не буферизуется. Остальные байты
+    // кадра игнорируются до следующего разрыва.
+    if (bytes_read_ == 2 && !isIdAccepted(value))
+    {
+      in_frame_ = false;
+      return;
+    }
+
+    LinFrame &frame = headFrame();
+    if (frame.num_bytes() >= LinFrame::kMaxBytes)
+    {
+      in_frame_ = false;
+      commitTooLongFrame();
+      return;
+    }
+    frame.append_byte(value);
+  }
+
+  inline void EdgeDecoder::handleEdgeIsr()
+  {
+    // Время и уровень как можно раньше, чтобы избежать джиттера.
+    const uint16 ticks = hardware_clock::ticksForIsr();
+    const uint8 level = rx_pin::isHigh();
+
+    // Уровень не изменился: короткая помеха, оба фронта которой уже прошли.
+    if (level == level_)
+    {
+      return;
+    }
+
+    if (!level)
+    {
+      addSyncFallingEdge(ticks);
+    }
+
+    if (state_ == kInByte)
+    {
+      sampleUntil(ticks);
+      if (bit_index_ < Config::kBitsPerByte)
+      {
+        level_ = level;
+        return;
+      }
+      // Середина стопового бита уже прошла, но совпадение Timer1 еще не
+      // обработано (у INT0 более высокий приоритет). Завершаем байт здесь.
+      finishByte();
+    }
+
+    if (state_ == kInLowLevel)
+    {
+      // Здесь, когда стоповый бит оказался низким. Решаем по длительности низкого
+      // уровня: разрыв или ошибка стопового бита.
+      level_ = level;
+      state_ = kIdle;
+      const uint16 low_ticks = ticks - byte_start_ticks_;
+      if (low_ticks >= config.clock_ticks_per_break())
+      {
+        if (autobaud_mode != autobaud_modes::OFF)
+        {
+          startSyncMeasurement(low_ticks);
+        }
+        startFrame();
+      }
+      else if (in_frame_)
+      {
+        abortFrame(bytes_read_ == 0 ? errors::SYNC_BYTE : errors::STOP_BIT);
+      }
+      return;
+    }
+
+    // Ожидание стартового бита, возможно с тайм-аутом конца кадра.
+    level_ = level;
+    if (!level)
+    {
+      startByte(ticks);
+    }
+  }
+
+  inline void EdgeDecoder::handleTimeoutIsr()
+  {
+    // Тайм-аут ожидания следующего байта - конец кадра.
+    if (state_ != kInByte)
+    {
+      disarmTimeout();
+      if (in_frame_)
+      {
+        endFrame();
+      }
+      return;
+    }
+
+    // Здесь, когда в середине стопового бита. После последнего фронта уровень
+    // не менялся, назначаем его оставшимся битам.
+    sampleUntil(byte_start_ticks_ + config.clock_ticks_to_bit_center(Config::kBitsPerByte - 1));
+    finishByte();
+  }
+
+  // Вызывается, когда всем битам байта назначены уровни.
+  inline void EdgeDecoder::finishByte()
+  {
+    // Низкий стоповый бит: разрыв или ошибка, решается на следующем фронте.
+    if (!(bits_ & H(Config::kBitsPerByte - 1)))
+    {
+      disarmTimeout();
+      state_ = kInLowLevel;
+      return;
+    }
+
+    state_ = kIdle;
+
+    // Стартовый бит не удержался до середины. Помеха.
+    if (bits_ & H(0))
+    {
+      disarmTimeout();
+      if (in_frame_)
+      {
+        abortFrame(bytes_read_ == 0 ? errors::SYNC_BYTE : errors::START_BIT);
+      }
+      return;
+    }
+
+    handleByte((uint8)(bits_ >> 1));
+
+    // Ждем стартовый бит следующего байта не дольше kMaxSpaceBits.
+    if (in_frame_)
+    {
+      armTimeout(byte_start_ticks_ + config.clock_ticks_until_frame_end());
+    }
+    else
+    {
+      disarmTimeout();
+    }
+  }
+
+  // ----- Обработчики ISR -----
+
+  // Фронт RX (PD2).
+  ISR(INT0_vect)
+  {
+    EdgeDecoder::handleEdgeIsr();
+  }
+
+  // Совпадение Timer1 A: середина стопового бита или тайм-аут конца кадра.
+  ISR(TIMER1_COMPA_vect)
+  {
+    EdgeDecoder::handleTimeoutIsr();
+  }
+
+  // Совпадение Timer2 A: тик бита передачи. Включено, только пока кадр ожидает
+  // передачи. Свой кадр и ответ на заголовок принимаются декодером через INT0, как
+  // любые другие, с отметкой transmitted().
+  static inline void handleTimer2Isr()
+  {
+    if (!Transmitter::isActive())
+    {
+      if (!Transmitter::isBusy() || !EdgeDecoder::isIdle())
+      {
+        return;
+      }
+      Transmitter::begin();
+    }
+    const uint8 result = Transmitter::handleTick();
+    if (result == tx_results::MORE)
+    {
+      return;
+    }
+    if (result == tx_results::BIT_ERROR)
+    {
+      EdgeDecoder::dropTransmittedFrame();
+    }
+    else if (!Transmitter::isResponse() && Transmitter::isHeaderOnly() && startResponse(Transmitter::pid()))
+    {
+      // Ответ на свой заголовок из таблицы.
+      return;
+    }
+    // После ответа в очереди может остаться свой кадр.
+    if (!Transmitter::isBusy())
+    {
+      TIMSK2 &= ~H(OCIE2A);
+    }
+  }
+#endif
 
-    // Увеличиваем флаг isr, чтобы указать главному серверу, что ISR только что
-    // завершено и прерывания могут быть временно отключены без причины ISR
-    // дрожание.
-    isr_marker++;
+  ISR(TIMER2_COMPA_vect)
+  {
+    const uint8 late_counts = isr_timing::timer2LateCounts();
+    const uint16 start_ticks = isr_timing::isrStartTicks();
+    handleTimer2Isr();
+    isr_timing::recordIsrDuration(isr_timing::kinds::TIMER2_DURATION, start_ticks);
+    isr_timing::record(isr_timing::kinds::TIMER2_LATENCY, (uint16)late_counts << config.half_micros_shift());
   }
 } // пространство имен lin_processor
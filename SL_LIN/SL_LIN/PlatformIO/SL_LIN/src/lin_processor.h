@@ -2,24 +2,135 @@
 #define LIN_PROCESSOR_H
 
 #include "avr_util.h"
+#include "custom_defs.h"
 #include "lin_frame.h"
 
 // Использует
-// * Timer2 - используется для генерации битовых тиков.
+// * Timer2 - используется для генерации битовых тиков приема (LIN_RX_EDGE_DECODER == 0)
+// и передачи.
 // * OC2B (PD3) - тики выхода таймера. Для отладки. При необходимости можно изменить
 // чтобы не использовать этот вывод.
+// * INT0 - фронт стартового бита и конца разрыва (LIN_RX_EDGE_DECODER == 0), все
+// фронты RX (LIN_RX_EDGE_DECODER == 1).
+// * Совпадение Timer1 A - тайм-ауты (LIN_RX_EDGE_DECODER == 1). Timer1 при этом
+// продолжает свободно считать для hardware_clock.
 // * PD2 - вход LIN RX.
+// * PB4 (D12) - выход LIN TX.
 // * PC0, PC1, PC2, PC3 - отладочные выходы. Подробнее см. в файле .cpp.
 namespace lin_processor {
 // Вызов один раз в настройках программы.
 extern void setup();
 extern void loop();
 
-// Попытка прочитать следующий доступный кадр rx. Если доступно, верните true и установите
-// заданный буфер. В противном случае верните false и оставьте *buffer без изменений.
-// Байты синхронизации, идентификатора и контрольной суммы кадра, а также общий байт
-// количество не проверено.
-extern boolean readNextFrame(LinFrame* buffer);
+// Размер очереди принятых кадров в байтах. Кадр занимает LinFrame::recordSize():
+// 5 байтов сведений и 32-битной метки времени и байты кадра (PID, данные, сумма).
+// Еще sizeof(LinFrame) = 16 байтов всегда свободны под собираемый кадр. До
+// BUFFER_OVERRUN помещается 22-24 заголовка без ответа, 15-16 кадров с 2 байтами
+// данных, 12-13 с 4 и 8-9 с 8 (в зависимости от того, где в буфере начало очереди).
+// В прежних 8 ячейках по 16 байтов (128 байтов) помещалось 7 кадров любой длины:
+// выигрыш около 2 раз для типичных кадров, а не 3-4, и на 32 байта SRAM больше.
+//
+// Метка хранится 32-битной, а не 16-битной (5 байтов сведений вместо 3), потому что
+// кадр может ждать в очереди, пока хост не примет вывод, дольше круга 16-битных
+// часов (262 мс), и расширить ее при выводе уже нельзя (см. pushHeadFrameBuffer()).
+static const uint8 kFrameRingSize = 160;
+
+// Очередь принятых кадров. Читается из main без запрета прерываний и без
+// копирования: peekFrame() возвращает самый старый кадр прямо из очереди, а
+// commitFrame() возвращает его буфер ISR. Пока кадр не освобожден, ISR его не
+// трогает; когда очередь заполнена, новые кадры отбрасываются с
+// errors::BUFFER_OVERRUN.
+// Кадр уже проверен в ISR, результат - LinFrame::status(). Кадры с ошибками тоже
+// попадают в очередь.
+
+// Есть ли готовый кадр.
+extern boolean frameAvailable();
+
+// Самый старый кадр. Только если frameAvailable(). Ссылка действительна до commitFrame().
+extern const LinFrame& peekFrame();
+
+// Освободить кадр peekFrame().
+extern void commitFrame();
+
+// Фильтр приема. Бит (id & 7) байта bitmap[id >> 3] разрешает кадры с этим ID LIN.
+// Кадры с остальными ID отбрасываются в ISR сразу после байта PID и не занимают
+// буфер. По умолчанию разрешены все ID.
+extern void setIdFilter(const uint8 bitmap[8]);
+
+// Режимы автоопределения скорости LIN по байту синхронизации 0x55.
+namespace autobaud_modes {
+// Скорость custom_defs::kLinSpeed или заданная setBaud().
+static const uint8 OFF = 0;
+// Ближайшая из стандартных скоростей LIN (2400, 4800, 9600, 10417, 19200, 20000).
+static const uint8 STANDARD = 1;
+// Измеренная скорость без округления.
+static const uint8 EXACT = 2;
+}
+
+// Включить или выключить автоопределение скорости. Выученные типы контрольных сумм
+// (lin_ids) сбрасываются. При включении прием начинается
+// с поиска: кадры только измеряются и не буферизуются, пока скорость не захвачена.
+// Захват теряется, если за 2 с не пришло ни одного байта синхронизации, и поиск
+// начинается заново.
+extern void setAutobaudMode(uint8 mode);
+
+// Диапазон скоростей приема, бод.
+static const uint32 kMinBaud = 1000;
+// Выше этой скорости (LIN_RX_HIGH_SPEED, LIN_RX_EDGE_DECODER == 0) - прием для
+// сеансов диагностики и прошивки той же выборкой по Timer2, каждый ISR короткий.
+// Только прием: передача (transmitFrame(), таблица ответов) и автоопределение
+// работают до kMaxSampledBaud.
+//
+// Предел - модель стенда (bench/lin_bench.cpp), а не измерение на AVR: стоимость
+// ISR оценена по коду, и перед каждым входом в ISR стенд ставит худшее прерывание
+// UART. Наибольшее смещение выборки от середины бита без помех, байты вплотную:
+// 20000 бод - 23%, 25000 - 29%, 28000 - 34%, 30000 - 48%, с 33000 кадры теряются:
+// стоповый бит (конец байта) обрабатывается дольше, чем полбита до следующего
+// стартового. Поэтому предел 25000 с запасом на погрешность модели. Асимметрия
+// фронтов трансивера и уход тактового генератора не моделируются. Выше ~30000
+// нужен другой способ приема, не ISR на каждом бите.
+static const uint32 kMaxSampledBaud = 20000;
+#if LIN_RX_HIGH_SPEED && !LIN_RX_EDGE_DECODER
+static const uint32 kMaxBaud = 25000;
+#else
+static const uint32 kMaxBaud = kMaxSampledBaud;
+#endif
+
+// Установить скорость приема, kMinBaud..kMaxBaud (вне диапазона - 9600).
+// Выключает автоопределение. Текущий кадр теряется.
+extern void setBaud(uint32 baud);
+
+// Текущая скорость приема, бод.
+extern uint32 baud();
+
+// Если с прошлого вызова скорость была захвачена или захват потерян, вернуть true
+// и установить *locked_baud (0 - захват потерян). Вызывается из main.
+extern boolean getAndClearBaudLockChange(uint16* locked_baud);
+
+// Поставить кадр в очередь передачи (режим ведущего). bytes - PID, затем данные и
+// контрольная сумма; один байт - только заголовок, ответ подчиненного устройства
+// принимается как обычный кадр. Разрыв и байт синхронизации добавляются здесь.
+// Кадр передается из ISR, когда шина свободна, функция не ждет. Возвращает false,
+// если предыдущий кадр еще не передан, скорость не захвачена или выше kMaxSampledBaud.
+// Каждый бит сверяется с RX. При расхождении передача прерывается с
+// errors::BIT_ERROR, иначе кадр попадает в буфер приема с LinFrame::transmitted().
+// Это подтверждение того, что кадр действительно был на шине.
+extern boolean transmitFrame(const uint8* bytes, uint8 num_bytes);
+
+// Кадр ожидает передачи или передается.
+extern boolean isTransmitting();
+
+// Таблица ответов (эмуляция подчиненных устройств). На заголовок с этим ID
+// устройство само передает data_size (1..8) байтов данных и контрольную сумму
+// сразу после PID, из ISR приема. Тип контрольной суммы -
+// lin_ids::usesEnhancedChecksum() на момент передачи ответа. Запись заменяется атомарно, без остановки приема. Не более 8 ID.
+// Возвращает false, если таблица заполнена или длина неверна.
+extern boolean setResponse(uint8 id, const uint8* data, uint8 data_size);
+
+// Удалить ID из таблицы ответов. Возвращает false, если его нет.
+extern boolean removeResponse(uint8 id);
+
+extern void clearResponses();
 
 // Маски байтов ошибок для отдельных битов ошибок.
 namespace errors {
@@ -30,6 +141,8 @@ static const uint8 STOP_BIT = (1 << 3);
 static const uint8 SYNC_BYTE = (1 << 4);
 static const uint8 BUFFER_OVERRUN = (1 << 5);
 static const uint8 OTHER = (1 << 6);
+// Уровень RX при передаче не совпал с переданным битом (коллизия). Кадр прерван.
+static const uint8 BIT_ERROR = (1 << 7);
 }
 
 // Получить текущий флаг ошибки и очистить его.
@@ -3,8 +3,11 @@
 #include "custom_defs.h"
 #include "hardware_clock.h"
 #include "io_pins.h"
+#include "isr_timing.h"
 #include "lin_processor.h"
+#include "scheduler.h"
 #include "sio.h"
+#include "stats.h"
 #include "system_clock.h"
 #include "lawicel.h"
 
@@ -14,7 +17,7 @@ static ActionLed errors_activity_led(PORTB, 1);
 // Функция настройки Arduino. Вызывается один раз во время инициализации.
 void setup()
 {
-  // Жестко запрограммировано на скорость 115,2 кбод. Использует URART0, без прерываний.
+  // Скорость custom_defs::kHostBaud. Использует URART0 с прерываниями RX и TX.
   // Сначала инициализируйте это, так как некоторые методы настройки используют его.
   sio::setup();
 
@@ -32,39 +35,34 @@ void setup()
 // Метод Arduino loop(). Вызывается после установки(). Никогда не возвращается.
 // Это быстрый цикл, который не использует delay() или другие занятые циклы или
 // блокировка вызовов.
-void loop()
+// Не встраивается в main() Arduino: стенд sim/lin_sim.cpp находит начало итерации
+// по символу loop.
+__attribute__((noinline)) void loop()
 {
   // Наличие собственного цикла сокращает примерно 4 мкс на итерацию. Это также устраняет
   // любая базовая функциональность, которая может нам не понадобиться.
   // Периодические обновления.
   system_clock::loop();
   lin_processor::loop();
+  scheduler::loop();
   sio::loop();
+  stats::loop();
+  isr_timing::loop();
   errors_activity_led.loop();
 
-  // Печатать периодические текстовые сообщения, если нет активности.
-  static PassiveTimer idle_timer;
-  // Используется для запуска периодической печати ошибок.
-  static PassiveTimer lin_errors_timeout;
-  // Накапливает флаги ошибок до следующей печати.
-  static uint8 pending_lin_errors = 0;
-  const uint8 new_lin_errors = lin_processor::getAndClearErrorFlags();
-
-  // Обработка флагов ошибок процессора LIN.
+  // Обработка флагов ошибок процессора LIN. Каждая ошибка учитывается в stats
+  // (команда I), здесь только мигает светодиод ОШИБКИ.
+  if (lin_processor::getAndClearErrorFlags() && lawicel::isConnected == true)
   {
-    if (new_lin_errors && lawicel::isConnected == true)
-    {
-      // Сделать так, чтобы светодиод ERRORS мигал.
-      errors_activity_led.action();
-      idle_timer.restart();
-    }
+    errors_activity_led.action();
+  }
 
-    // Если есть ожидающие ошибки очистите.
-    pending_lin_errors |= new_lin_errors;
-    if (pending_lin_errors && lin_errors_timeout.timeMillis() > 1000)
+  // Сообщить хосту о захвате скорости LIN при автоопределении (команда G).
+  {
+    uint16 locked_baud;
+    if (lin_processor::getAndClearBaudLockChange(&locked_baud))
     {
-      lin_errors_timeout.restart();
-      pending_lin_errors = 0;
+      sio::printBaudLock(locked_baud);
     }
   }
 
@@ -0,0 +1,173 @@
+#include "scheduler.h"
+
+#include "lin_transmitter.h"
+#include "system_clock.h"
+
+namespace scheduler
+{
+  static const uint8 kMaxDataBytes = 8;
+
+  // 14 байт на ID, 224 байта всего.
+  struct Entry
+  {
+    uint8 id;
+    uint8 data_size;
+    uint8 data[kMaxDataBytes];
+    uint16 period_millis;
+    // Младшие 16 бит system_clock::timeMillis() следующей передачи. Периоды не
+    // больше kMaxPeriodMillis (32,7 с), поэтому хватает знаковой 16-битной разности.
+    uint16 due_millis;
+  };
+
+  // Занятые записи всегда в начале массива.
+  static Entry entries[kMaxEntries];
+  static uint8 num_entries = 0;
+  static boolean running = false;
+  // С какой записи начинать поиск следующей передачи. Если сроки нескольких ID
+  // наступили одновременно, они передаются по очереди.
+  static uint8 cursor = 0;
+
+  static inline uint16 nowMillis()
+  {
+    return (uint16)system_clock::timeMillis();
+  }
+
+  static Entry *findEntry(uint8 id)
+  {
+    id &= 0x3f;
+    for (uint8 i = 0; i < num_entries; i++)
+    {
+      if (entries[i].id == id)
+      {
+        return &entries[i];
+      }
+    }
+    return NULL;
+  }
+
+  static void copyData(Entry &entry, const uint8 data[], uint8 data_size)
+  {
+    entry.data_size = data_size;
+    for (uint8 i = 0; i < data_size; i++)
+    {
+      entry.data[i] = data[i];
+    }
+  }
+
+  boolean setEntry(uint8 id, const uint8 data[], uint8 data_size, uint16 period_millis)
+  {
+    if (data_size > kMaxDataBytes || !period_millis || period_millis > kMaxPeriodMillis)
+    {
+      return false;
+    }
+    Entry *entry = findEntry(id);
+    if (!entry)
+    {
+      if (num_entries >= kMaxEntries)
+      {
+        return false;
+      }
+      entry = &entries[num_entries++];
+      entry->id = id & 0x3f;
+    }
+    copyData(*entry, data, data_size);
+    entry->period_millis = period_millis;
+    entry->due_millis = nowMillis() + period_millis;
+    return true;
+  }
+
+  boolean updateData(uint8 id, const uint8 data[], uint8 data_size)
+  {
+    Entry *entry = findEntry(id);
+    if (!entry || data_size > kMaxDataBytes)
+    {
+      return false;
+    }
+    copyData(*entry, data, data_size);
+    return true;
+  }
+
+  boolean removeEntry(uint8 id)
+  {
+    Entry *entry = findEntry(id);
+    if (!entry)
+    {
+      return false;
+    }
+    // Последняя запись занимает место удаленной.
+    *entry = entries[--num_entries];
+    return true;
+  }
+
+  void clear()
+  {
+    running = false;
+    num_entries = 0;
+    cursor = 0;
+  }
+
+  void start()
+  {
+    const uint16 now = nowMillis();
+    for (uint8 i = 0; i < num_entries; i++)
+    {
+      entries[i].due_millis = now + entries[i].period_millis;
+    }
+    cursor = 0;
+    running = true;
+  }
+
+  void stop()
+  {
+    running = false;
+  }
+
+  boolean isRunning()
+  {
+    return running;
+  }
+
+  void loop()
+  {
+    // Кадр передается из ISR, следующий ставится в очередь после его окончания.
+    // Срок не сдвигается, поэтому ожидающий ID уходит сразу после освобождения.
+    if (!running || !num_entries || lin_transmitter::isBusy())
+    {
+      return;
+    }
+
+    // Не более одного кадра за вызов: передатчик принимает один кадр.
+    const uint16 now = nowMillis();
+    for (uint8 n = 0; n < num_entries; n++)
+    {
+      if (cursor >= num_entries)
+      {
+        cursor = 0;
+      }
+      Entry &entry = entries[cursor++];
+      if ((int16)(now - entry.due_millis) < 0)
+      {
+        continue;
+      }
+
+      // Срок следующей передачи отсчитывается от срока этой, а не от текущего
+      // времени, поэтому задержки основного цикла не накапливаются. Если отстали
+      // больше чем на период, пропускаем пропущенные передачи.
+      entry.due_millis += entry.period_millis;
+      if ((int16)(now - entry.due_millis) >= 0)
+      {
+        entry.due_millis = now + entry.period_millis;
+      }
+
+      if (entry.data_size)
+      {
+        lin_transmitter::writeLin(entry.id, entry.data, entry.data_size);
+      }
+      else
+      {
+        lin_transmitter::writeLinRequest(entry.id);
+      }
+      return;
+    }
+  }
+} // namespace scheduler
@@ -0,0 +1,44 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "avr_util.h"
+
+// Периодическая таблица передачи (режим ведущего). Повторяет список TxList из
+// CANHacker (.txl): у каждого ID свои данные и период. Кадры передаются из
+// основного цикла по system_clock без участия хоста, поэтому период не зависит
+// от задержек USB и ОС.
+// Требуются вызовы из основного цикла, не из ISR.
+namespace scheduler
+{
+  // Не более стольких ID в таблице.
+  static const uint8 kMaxEntries = 16;
+  // Наибольший период: сроки сравниваются знаковой 16-битной разностью.
+  static const uint16 kMaxPeriodMillis = 0x7fff;
+
+  extern void loop();
+
+  // Во всех функциях id - ID LIN или PID (как в .txl), биты четности игнорируются.
+
+  // Добавить ID в таблицу или заменить его данные и период. data_size 0 -
+  // передается только заголовок (опрос подчиненного устройства). Первая передача
+  // через период после запуска или добавления. Возвращает false, если таблица
+  // заполнена или аргументы неверны (период 0 или больше kMaxPeriodMillis).
+  extern boolean setEntry(uint8 id, const uint8 data[], uint8 data_size, uint16 period_millis);
+
+  // Заменить данные ID, не меняя период и фазу. Возвращает false, если ID нет в
+  // таблице или длина неверна.
+  extern boolean updateData(uint8 id, const uint8 data[], uint8 data_size);
+
+  // Удалить ID из таблицы. Возвращает false, если его нет.
+  extern boolean removeEntry(uint8 id);
+
+  // Остановить передачу и очистить таблицу.
+  extern void clear();
+
+  // Запуск и остановка передачи. Таблица сохраняется.
+  extern void start();
+  extern void stop();
+  extern boolean isRunning();
+} // namespace scheduler
+
+#endif
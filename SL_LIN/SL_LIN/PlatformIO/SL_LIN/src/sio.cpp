@@ -2,26 +2,32 @@
 #include "sio.h"
 #include "lin_processor.h"
 #include "lawicel.h"
-#include <stdarg.h>
 #include "passive_timer.h"
+#include "custom_defs.h"
+#include "isr_timing.h"
+#include "system_clock.h"
+#include "change_filter.h"
+#include "stats.h"
 namespace sio
 {
 
   // TODO: нужно ли установить контакты ввода/вывода (PD0, PD1)? Мы полагаемся на настройку
   // загрузчик?
 
-  // Размер очереди выходных байтов. Должно быть <= 128, чтобы избежать переполнения.
-  // TODO: уменьшить размер буфера? Хватит ли нам оперативной памяти?
-  // TODO: увеличить размер индекса до 16 бит и увеличить размер буфера до 200?
-  static const uint8 kQueueTXSize = 120;
   static const uint8 kQueueSerialRXSize = 64;
   static uint8 bufferTX[kQueueTXSize];
   static uint8 bufferSerial[kQueueSerialRXSize];
 
-  // Индекс самой старой записи в буфере TX.
-  static uint8 start;
-  // Количество байтов в очереди TX.
-  static uint8 count;
+  // 16-битные индексы были нужны очереди на 320 байтов. В 256 байтах 8-битные
+  // индексы пробегают все элементы и переходят через ноль сами, без сравнения с
+  // kQueueTXSize, а USART_UDRE_vect и main читают их одной командой, без cli().
+  // Очередь больше 256 байтов снова потребует 16-битных индексов и критической
+  // секции в queuedTXBytes().
+  static_assert(kQueueTXSize == 256, "Индексы очереди TX - uint8");
+  // Индекс следующей записи в буфере TX. Пишется только из main.
+  static volatile uint8 tx_head;
+  // Индекс самой старой записи в буфере TX. Пишется только из USART_UDRE_vect.
+  static volatile uint8 tx_tail;
   // Индекс самой старой записи в буфере TX.
   static volatile uint8 rx_buffer_head;
   // Количество байтов в очереди TX.
@@ -30,35 +36,54 @@ namespace sio
   // Светодиод FRAMES - мигает при обнаружении действительных кадров.
   static ActionLed frames_activity_led(PORTD, 7); // D7
 
-  // Вызывающий должен убедиться, что count < kQueueTXSize перед вызовом этого.
+  // Количество байтов в очереди TX. Вызывается из main.
+  static uint8 queuedTXBytes()
+  {
+    return (uint8)(tx_head - tx_tail);
+  }
+
+  // Вызывающий должен убедиться, что capacity() > 0 перед вызовом этого.
   static void unsafe_enqueue(byte b)
   {
-    // kQueueTXSize достаточно мал, чтобы не было переполнения.
-    uint8 next = start + count;
-    if (next >= kQueueTXSize)
-    {
-      next -= kQueueTXSize;
-    }
-    bufferTX[next] = b;
-    count++;
+    const uint8 head = tx_head;
+    bufferTX[head] = b;
+    const uint8 next = head + 1;
+    // Индекс и разрешение прерывания меняем атомарно относительно USART_UDRE_vect,
+    // который читает tx_head и сам запрещает себя на пустой очереди.
+    cli();
+    tx_head = next;
+    UCSR0B |= H(UDRIE0);
+    stats::updateTxQueueUsage((uint8)(next - tx_tail));
+    sei();
   }
 
-  // Вызывающий должен убедиться, что count > 1 перед вызовом этого.
-  static byte unsafe_dequeue()
+  // Регистр данных UART свободен. Передает следующий байт очереди, на пустой
+  // очереди запрещает прерывание USART_UDRE_vect до следующего unsafe_enqueue().
+  static inline void transmitNextByte()
   {
-    const uint8 b = bufferTX[start];
-    if (++start >= kQueueTXSize)
+    uint8 tail = tx_tail;
+    if (tail == tx_head)
     {
-      start = 0;
+      UCSR0B &= ~H(UDRIE0);
+      return;
+    }
+    UDR0 = bufferTX[tail++];
+    tx_tail = tail;
+    if (tail == tx_head)
+    {
+      UCSR0B &= ~H(UDRIE0);
     }
-    count--;
-    return b;
+  }
+
+  ISR(USART_UDRE_vect)
+  {
+    transmitNextByte();
   }
 
   void setup()
   {
-    start = 0;
-    count = 0;
+    tx_head = 0;
+    tx_tail = 0;
     rx_buffer_head = 0;
     rx_buffer_tail = 0;
     lawicel::RX_Index = 0;
@@ -66,26 +91,44 @@ namespace sio
     frames_activity_led.action();
 
     // Девизы см. в таблице 19-12 в техническом описании atmega328p.
-    // U2X0, 16 -> 115,2 кбод при 16 МГц.
+    // С U2X0 скорость = 16 МГц / (8 * (UBRR0 + 1)), см. custom_defs::kHostBaud.
+    // U2X0, 1 -> 1 Мбод, 3 -> 500 кбод, 7 -> 250 кбод (точно).
+    // U2X0, 16 -> 115,2 кбод при 16 МГц (ошибка 2,1%).
     // U2X0, 207 -> 9600 бод @ 16 МГц.
-    UBRR0H = 0;
-    UBRR0L = 16; // Скорость uart
+    const uint16 ubrr = ((F_CPU / 8) + (custom_defs::kHostBaud / 2)) / custom_defs::kHostBaud - 1;
+    UBRR0H = (uint8)(ubrr >> 8);
+    UBRR0L = (uint8)ubrr; // Скорость uart
     // Бит U2X0 (1) регистра UCSR0A - удвоение скорости обмена, если установить в 1 (только в асинхронном режиме. в синхронном следует установить этот бит в 0).
     UCSR0A = H(U2X0);
-    // Включаем приемник. Включить передатчик. Разрешаем прирывания.
+    // Включаем приемник. Включить передатчик. Разрешаем прирывания приема.
+    // Прерывание передачи (UDRIE0) разрешается, пока в очереди есть байты.
     UCSR0B = H(RXEN0) | H(TXEN0) | H(RXCIE0);
     UCSR0C = H(UDORD0) | H(UCPHA0);
     sei(); // разрешение глобального прерывания
   }
 
-  ISR(USART_RX_vect)
+  // Принятый байт UART в очередь.
+  static inline void receiveByte()
   {
+    // UDR0 читается всегда, иначе прерывание повторяется, пока буфер заполнен.
+    const uint8 c = UDR0;
     uint8 i = (rx_buffer_head + 1) % kQueueSerialRXSize;
     if (i != rx_buffer_tail)
     {
-      bufferSerial[rx_buffer_head] = UDR0;
+      bufferSerial[rx_buffer_head] = c;
       rx_buffer_head = i;
     }
+    else
+    {
+      stats::countSerialRxDrop();
+    }
+  }
+
+  ISR(USART_RX_vect)
+  {
+    const uint16 start_ticks = isr_timing::isrStartTicks();
+    receiveByte();
+    isr_timing::recordIsrDuration(isr_timing::kinds::SERIAL_RX_DURATION, start_ticks);
   }
 
   int available()
@@ -112,8 +155,9 @@ namespace sio
   {
     // Если буфер заполнен, отбрасываем этот символ.
     // TODO: отбросить последний байт, чтобы освободить место для нового байта?
-    if (count >= kQueueTXSize)
+    if (!capacity())
     {
+      stats::countSerialTxDrops(1);
       return;
     }
     unsafe_enqueue(c);
@@ -122,21 +166,17 @@ namespace sio
   void loop()
   {
     frames_activity_led.loop();
-    if (count && (UCSR0A & H(UDRE0)))
-    {
-      UDR0 = unsafe_dequeue();
-    }
   }
 
-  uint8 capacity()
+  uint16 capacity()
   {
-    return kQueueTXSize - count;
+    return (kQueueTXSize - 1) - queuedTXBytes();
   }
 
   void waitUntilFlushed()
   {
-    // Цикл занятости до тех пор, пока все не будет сброшено в UART.
-    while (count)
+    // Цикл занятости до тех пор, пока USART_UDRE_vect не передаст все в UART.
+    while (queuedTXBytes())
     {
       loop();
     }
@@ -166,28 +206,262 @@ namespace sio
     printchar('\n');
   }
 
+  // ----- Двоичный формат вывода кадров -----
+  //
+  // Запись: kRecordMarker, N, SEQ_L, SEQ_H, N байтов кадров, CRC8.
+  // Каждый кадр в записи: количество байтов, затем сами байты (PID, данные,
+  // контрольная сумма), как в LinFrame. При Z1 в количестве байтов установлен
+  // kRecordTimestampFlag, и за ним следует 32-битная метка времени кадра в тиках
+  // 4 мкс (младший байт первым). У кадров, переданных этим устройством
+  // (LinFrame::transmitted()), в количестве байтов установлен kRecordTxFlag.
+  // Кадры с ошибкой тоже передаются: в количестве байтов установлен
+  // kRecordStatusFlag, и перед байтами кадра идет байт LinFrame::status().
+  // SEQ - 16-битный номер первого кадра записи, последующие кадры записи имеют
+  // номера SEQ + 1, SEQ + 2 и т.д. Если запись не помещается в выходной буфер, она
+  // отбрасывается целиком, но номера ее кадров пропускаются, и хост видит разрыв.
+  // В режиме изменений (change_filter) запись может содержать и сводку повторов:
+  // байт kRecordSummaryFlag, PID, число повторов. Сводка тоже получает номер.
+  // Так же, с kRecordSummaryFlag и номером, передаются события: байт
+  // kRecordSummaryFlag | вид события (младшие 4 бита, 0 - сводка), затем два байта.
+  // kRecordEventBaudLock - захват скорости LIN при автоопределении, скорость в бод
+  // (младший байт первым), 0 - захват потерян.
+  // CRC8 (полином 0x07, начальное значение 0) считается по N, SEQ и кадрам.
+  //
+  // Запись отправляется, когда следующий кадр в нее не помещается или когда
+  // выходной буфер пуст. Пока UART занят, кадры накапливаются в одной записи.
+  // Ответы на команды остаются ASCII; байт kRecordMarker в них не встречается.
+
+  static const uint8 kRecordMarker = 0xA5;
+  static const uint8 kRecordTimestampFlag = 0x80;
+  static const uint8 kRecordSummaryFlag = 0x40;
+  static const uint8 kRecordTxFlag = 0x20;
+  static const uint8 kRecordStatusFlag = 0x10;
+  static const uint8 kRecordEventBaudLock = 0x01;
+  static const uint8 kMaxRecordPayload = 4 * (1 + 4 + 1 + LinFrame::kMaxBytes);
+
+  static boolean binary_mode = false;
+  static uint8 record_payload[kMaxRecordPayload];
+  static uint8 record_payload_size;
+  static uint16 record_first_seq;
+  static uint16 next_frame_seq;
+
+  void setBinaryMode(boolean enabled)
+  {
+    binary_mode = enabled;
+    record_payload_size = 0;
+    next_frame_seq = 0;
+  }
+
+  static uint8 crc8Update(uint8 crc, uint8 b)
+  {
+    crc ^= b;
+    for (uint8 i = 0; i < 8; i++)
+    {
+      crc = (crc & 0x80) ? (uint8)((crc << 1) ^ 0x07) : (uint8)(crc << 1);
+    }
+    return crc;
+  }
+
+  static void flushRecord()
+  {
+    const uint8 n = record_payload_size;
+    if (!n)
+    {
+      return;
+    }
+    record_payload_size = 0;
+
+    // Маркер, N, SEQ (2), данные, CRC. Запись не режется: либо целиком, либо никак.
+    if (capacity() < n + 5)
+    {
+      stats::countSerialTxDrops(n + 5);
+      return;
+    }
+
+    const uint8 seq_low = (uint8)record_first_seq;
+    const uint8 seq_high = (uint8)(record_first_seq >> 8);
+    unsafe_enqueue(kRecordMarker);
+    unsafe_enqueue(n);
+    unsafe_enqueue(seq_low);
+    unsafe_enqueue(seq_high);
+    uint8 crc = crc8Update(crc8Update(crc8Update(0, n), seq_low), seq_high);
+    for (uint8 i = 0; i < n; i++)
+    {
+      const uint8 b = record_payload[i];
+      unsafe_enqueue(b);
+      crc = crc8Update(crc, b);
+    }
+    unsafe_enqueue(crc);
+  }
+
+  static void appendRecordFrame(const LinFrame &frame)
+  {
+    const uint8 num_bytes = frame.num_bytes();
+    const boolean with_status = !frame.isValid();
+    const uint8 count = num_bytes | (frame.transmitted() ? kRecordTxFlag : 0) | (with_status ? kRecordStatusFlag : 0);
+    const boolean with_timestamp = lawicel::timestampsEnabled;
+    if (record_payload_size + 1 + (with_timestamp ? 4 : 0) + (with_status ? 1 : 0) + num_bytes > kMaxRecordPayload)
+    {
+      flushRecord();
+    }
+    if (!record_payload_size)
+    {
+      record_first_seq = next_frame_seq;
+    }
+    next_frame_seq++;
+    if (with_timestamp)
+    {
+      record_payload[record_payload_size++] = count | kRecordTimestampFlag;
+      const uint32 ticks = frame.timestamp_ticks();
+      record_payload[record_payload_size++] = (uint8)ticks;
+      record_payload[record_payload_size++] = (uint8)(ticks >> 8);
+      record_payload[record_payload_size++] = (uint8)(ticks >> 16);
+      record_payload[record_payload_size++] = (uint8)(ticks >> 24);
+    }
+    else
+    {
+      record_payload[record_payload_size++] = count;
+    }
+    if (with_status)
+    {
+      record_payload[record_payload_size++] = frame.status();
+    }
+    for (uint8 i = 0; i < num_bytes; i++)
+    {
+      record_payload[record_payload_size++] = frame.get_byte(i);
+    }
+  }
+
+  // Сводка повторов (event 0) или событие kRecordEvent*.
+  static void appendRecordEvent(uint8 event, uint8 b0, uint8 b1)
+  {
+    if (record_payload_size + 3 > kMaxRecordPayload)
+    {
+      flushRecord();
+    }
+    if (!record_payload_size)
+    {
+      record_first_seq = next_frame_seq;
+    }
+    next_frame_seq++;
+    record_payload[record_payload_size++] = kRecordSummaryFlag | event;
+    record_payload[record_payload_size++] = b0;
+    record_payload[record_payload_size++] = b1;
+  }
+
+  void printBaudLock(uint16 baud)
+  {
+    if (binary_mode)
+    {
+      appendRecordEvent(kRecordEventBaudLock, (uint8)baud, (uint8)(baud >> 8));
+      flushRecord();
+      return;
+    }
+    printchar('a');
+    printdec(baud);
+    printchar(CR);
+  }
+
+  // Самая длинная строка кадра ASCII: "t", PID, пробел, DLC, 8 байтов данных,
+  // метка времени, сумма, CR.
+  static const uint8 kMaxFrameLineSize = 1 + 2 + 2 + 2 * (LinFrame::kMaxBytes - 1) + 4 + 1;
+
+  // Вызывается один раз для каждого кадра очереди. Кадр с ошибкой (статус проверки
+  // из ISR) передается только в двоичном режиме.
+  static boolean acceptFrame(const LinFrame &frame)
+  {
+    if (!frame.isValid())
+    {
+      return binary_mode;
+    }
+    frames_activity_led.action();
+    if (!change_filter::isEnabled())
+    {
+      return true;
+    }
+    // В режиме изменений кадр с прежними данными только учитывается в сводке.
+    // Свой переданный кадр ("e") - подтверждение передачи для хоста, он выводится
+    // всегда, но тоже обновляет кеш.
+    return change_filter::acceptFrame(frame) || frame.transmitted();
+  }
+
   extern void print_computer()
   {
-    LinFrame frame;
-    if (lin_processor::readNextFrame(&frame))
+    // Кадр кодируется прямо из очереди lin_processor и освобождается после этого.
+    const LinFrame *frame = lin_processor::frameAvailable() ? &lin_processor::peekFrame() : NULL;
+    uint8 summaryPid;
+    uint8 summaryRepeats;
+
+    if (binary_mode)
     {
-      const boolean frameOk = frame.isValid();
-      if (frameOk)
+      if (frame)
       {
-        printchar('t');
-        for (int i = 0; i < frame.num_bytes(); i++)
+        if (acceptFrame(*frame))
         {
-          frames_activity_led.action();
-          if (i == 1)
-          {
-            printchar(' ');
-            printchar(lawicel::getDlc(frame.num_bytes()));
-          }
-          printhex2(frame.get_byte(i));
+          appendRecordFrame(*frame);
         }
-        printchar(CR);
+        lin_processor::commitFrame();
+      }
+      if (change_filter::nextSummary(&summaryPid, &summaryRepeats))
+      {
+        appendRecordEvent(0, summaryPid, summaryRepeats);
+      }
+      if (!queuedTXBytes())
+      {
+        flushRecord();
       }
+      return;
+    }
+
+    // Сводка повторов: kPPRR, где PP - PID, RR - число повторов с прошлой сводки.
+    // По одной строке за вызов и только если строка поместится целиком.
+    if (capacity() >= 6 && change_filter::nextSummary(&summaryPid, &summaryRepeats))
+    {
+      printchar('k');
+      printhex2(summaryPid);
+      printhex2(summaryRepeats);
+      printchar(CR);
     }
+
+    // Строка кадра не помещается в выходной буфер: кадр ждет в очереди, а не
+    // выводится обрезанным.
+    if (!frame || (frame->isValid() && capacity() < kMaxFrameLineSize))
+    {
+      return;
+    }
+
+    if (acceptFrame(*frame))
+    {
+      // Свой переданный кадр: "e" вместо "t", остальное так же.
+      printchar(frame->transmitted() ? 'e' : 't');
+      // DLC считает только данные, поэтому контрольная сумма (последний байт кадра
+      // с данными) идет после полей LAWICEL, за меткой времени.
+      const uint8 num_bytes = frame->num_bytes();
+      const uint8 num_fields = (num_bytes > 1) ? num_bytes - 1 : num_bytes;
+      for (uint8 i = 0; i < num_fields; i++)
+      {
+        frames_activity_led.action();
+        if (i == 1)
+        {
+          printchar(' ');
+          printchar(lawicel::getDlc(num_bytes));
+        }
+        printhex2(frame->get_byte(i));
+      }
+      // Метка времени LAWICEL: миллисекунды по модулю 60000.
+      if (lawicel::timestampsEnabled)
+      {
+        const uint16 millis = system_clock::ticksToMillis(frame->timestamp_ticks()) % 60000;
+        printhex2((uint8)(millis >> 8));
+        printhex2((uint8)millis);
+      }
+      if (num_fields < num_bytes)
+      {
+        printhex2(frame->get_byte(num_fields));
+      }
+      printchar(CR);
+    }
+    lin_processor::commitFrame();
   }
 
   void print(const __FlashStringHelper *str)
@@ -229,17 +503,19 @@ namespace sio
     println();
   }
 
-  void printf(const __FlashStringHelper *format, ...)
+  void printdec(uint16 value)
   {
-    // Предполагается один поток, использующий статический буфер.
-    static char buf[80];
-    va_list ap;
-    va_start(ap, format);
-    vsnprintf_P(buf, sizeof(buf), (const char *)format, ap); // программа для AVR
-    for (char *p = &buf[0]; *p; p++)                         // эмулировать приготовленный режим для новых строк
+    // Цифры с младшей, не более 5.
+    char digits[5];
+    uint8 n = 0;
+    do
+    {
+      digits[n++] = (char)('0' + value % 10);
+      value /= 10;
+    } while (value);
+    while (n)
     {
-      printchar(*p);
+      printchar(digits[--n]);
     }
-    va_end(ap);
   }
 } // пространство имен sio
\ No newline at end of file
@@ -5,21 +5,26 @@
 #include "avr_util.h"
 #include "lawicel.h"
 
-// Последовательный выход, использующий аппаратный UART0 и без прерываний (для более низких
-// дрожание прерывания). Требуются периодические вызовы update() для отправки в буфер.
-// байты в UART.
+// Последовательный порт на аппаратном UART0. Прием и передача на прерываниях
+// (USART_RX_vect и USART_UDRE_vect), поэтому скорость вывода не зависит от частоты
+// вызовов loop(). Скорость задается custom_defs::kHostBaud.
 //
 // Выход TX — TXD (PD1) — контакт 31
 // Вход RX — RXD (PD0— контакт 30
 namespace sio {
 
+// Размер очереди выходных байтов. Один элемент всегда свободен, чтобы отличать
+// полную очередь от пустой: в очереди до 255 байтов, около 22 мс вывода при
+// 115200 бод. Индексы 8-битные (см. sio.cpp).
+static const uint16 kQueueTXSize = 256;
+
 // Вызов из main setup(и loop(соответственно.
 extern void setup();
 extern void loop();
 
 // Мгновенный размер свободного места в выходном буфере. Отправка не более этого номера
 // символов не потеряет ни одного байта.
-extern uint8 capacity();
+extern uint16 capacity();
 
 extern char serial_read ();
 extern int available();
@@ -30,7 +35,14 @@ extern void print(const char *str);
 extern void println(const char *str);
 extern void println();
 extern void print_computer();
-extern void printf(const __FlashStringHelper *format, ...);
+// Формат вывода кадров в print_computer(). false - ASCII LAWICEL (по умолчанию),
+// true - двоичные записи с несколькими кадрами (см. sio.cpp).
+extern void setBinaryMode(boolean enabled);
+// Сообщить о захвате скорости LIN (baud) или его потере (0): строка "a<бод>\r" в
+// режиме ASCII, событие записи в двоичном режиме.
+extern void printBaudLock(uint16 baud);
+// Десятичное число без знака.
+extern void printdec(uint16 value);
 extern void printhex2(uint8 b);
 
 // Ожидание в цикле занятости, пока все байты не будут сброшены в UART.
@@ -0,0 +1,202 @@
+#include "stats.h"
+
+#include "change_filter.h"
+#include "lawicel.h"
+#include "lin_processor.h"
+#include "sio.h"
+#include "system_clock.h"
+
+namespace stats
+{
+  namespace stats_private
+  {
+    uint16 id_frames[64];
+    uint8 id_errors[64];
+    uint16 error_counts[8];
+    uint16 status_counts[4];
+    uint16 serial_rx_drops;
+    uint16 serial_tx_drops;
+    uint8 frame_queue_max;
+    uint16 tx_queue_max;
+    uint16 change_filter_evictions;
+  } // namespace stats_private
+
+  using namespace stats_private;
+
+  // Строки вывода по порядку. После kLineIds идут строки ID, по одной на ID с
+  // ненулевыми счетчиками.
+  static const uint8 kLineUptime = 0;
+  static const uint8 kLineErrors = 1;
+  static const uint8 kLineStatuses = 2;
+  static const uint8 kLineSerial = 3;
+  static const uint8 kLineQueues = 4;
+  static const uint8 kLineChangeFilter = 5;
+  static const uint8 kLineIds = 6;
+  static const uint8 kLineEnd = kLineIds + 64;
+  // Вывод не идет.
+  static const uint8 kLineNone = 0xff;
+
+  // Самая длинная строка: "ie", 8 счетчиков по 4 цифры, CR.
+  static const uint8 kMaxLineSize = 2 + 8 * 4 + 1;
+
+  static uint8 dump_line = kLineNone;
+  static boolean dump_reset;
+
+  void startDump(boolean reset)
+  {
+    dump_line = kLineUptime;
+    dump_reset = reset;
+  }
+
+  static void printHex16(uint16 value)
+  {
+    sio::printhex2((uint8)(value >> 8));
+    sio::printhex2((uint8)value);
+  }
+
+  // Счетчики, которые меняет ISR, читаются и сбрасываются с запрещенными
+  // прерываниями.
+  static uint16 take(uint16 &counter)
+  {
+    cli();
+    const uint16 value = counter;
+    if (dump_reset)
+    {
+      counter = 0;
+    }
+    sei();
+    return value;
+  }
+
+  static void printCounters(char kind, uint16 counters[], uint8 num_counters)
+  {
+    sio::printchar('i');
+    sio::printchar(kind);
+    for (uint8 i = 0; i < num_counters; i++)
+    {
+      printHex16(take(counters[i]));
+    }
+    sio::printchar(CR);
+  }
+
+  // Вывести строку ID, если у него есть кадры.
+  static void printId(uint8 id)
+  {
+    cli();
+    const uint16 frames = id_frames[id];
+    const uint8 errors = id_errors[id];
+    if (dump_reset)
+    {
+      id_frames[id] = 0;
+      id_errors[id] = 0;
+    }
+    sei();
+    if (!frames && !errors)
+    {
+      return;
+    }
+    sio::printchar('i');
+    sio::printchar('n');
+    sio::printhex2(id);
+    printHex16(frames);
+    sio::printhex2(errors);
+    sio::printchar(CR);
+  }
+
+  // Вывести строку line. Места в выходном буфере достаточно.
+  static void printLine(uint8 line)
+  {
+    switch (line)
+    {
+    case kLineUptime:
+    {
+      // Секунды с запуска.
+      const uint32 seconds = system_clock::timeMillis() / 1000;
+      sio::printchar('i');
+      sio::printchar('u');
+      printHex16((uint16)(seconds >> 16));
+      printHex16((uint16)seconds);
+      sio::printchar(CR);
+      return;
+    }
+    case kLineErrors:
+      return printCounters('e', error_counts, 8);
+    case kLineStatuses:
+      return printCounters('f', status_counts, 4);
+    case kLineSerial:
+    {
+      // serial_tx_drops меняет только main.
+      const uint16 rx_drops = take(serial_rx_drops);
+      const uint16 tx_drops = serial_tx_drops;
+      if (dump_reset)
+      {
+        serial_tx_drops = 0;
+      }
+      sio::printchar('i');
+      sio::printchar('s');
+      printHex16(rx_drops);
+      printHex16(tx_drops);
+      sio::printchar(CR);
+      return;
+    }
+    case kLineQueues:
+    {
+      cli();
+      const uint8 frame_max = frame_queue_max;
+      const uint16 tx_max = tx_queue_max;
+      if (dump_reset)
+      {
+        frame_queue_max = 0;
+        tx_queue_max = 0;
+      }
+      sei();
+      sio::printchar('i');
+      sio::printchar('q');
+      sio::printhex2(frame_max);
+      sio::printhex2(lin_processor::kFrameRingSize);
+      printHex16(tx_max);
+      printHex16(sio::kQueueTXSize);
+      sio::printchar(CR);
+      return;
+    }
+    case kLineChangeFilter:
+    {
+      // change_filter_evictions меняется только из main.
+      const uint16 evictions = change_filter_evictions;
+      if (dump_reset)
+      {
+        change_filter_evictions = 0;
+      }
+      sio::printchar('i');
+      sio::printchar('c');
+      sio::printhex2(change_filter::numCachedIds());
+      sio::printhex2(change_filter::kMaxCachedIds);
+      printHex16(evictions);
+      sio::printchar(CR);
+      return;
+    }
+    }
+  }
+
+  void loop()
+  {
+    while (dump_line != kLineNone && sio::capacity() >= kMaxLineSize)
+    {
+      if (dump_line == kLineEnd)
+      {
+        sio::printchar(CR);
+        dump_line = kLineNone;
+        return;
+      }
+      const uint8 line = dump_line++;
+      if (line < kLineIds)
+      {
+        printLine(line);
+      }
+      else
+      {
+        printId(line - kLineIds);
+      }
+    }
+  }
+} // namespace stats
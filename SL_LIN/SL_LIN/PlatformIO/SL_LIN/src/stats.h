@@ -0,0 +1,114 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "avr_util.h"
+#include "lin_frame.h"
+
+// Счетчики для диагностики в поле: кадры и ошибочные кадры каждого ID, ошибки
+// приема (lin_processor::errors), статусы кадров, потерянные байты
+// последовательного порта, наибольшее заполнение очередей, переполнение кеша
+// change_filter. Выводятся командой I
+// (см. lawicel.h).
+//
+// Функции count*() и update*() вызываются из ISR или main в местах событий и
+// рассчитаны на ISR: только инкремент в памяти. Счетчики 16-битные и по кругу не
+// насыщаются, кроме ошибок по ID (8 бит, до 0xff).
+namespace stats
+{
+  // Частные данные. Не использовать из других модулей.
+  namespace stats_private
+  {
+    extern uint16 id_frames[64];
+    extern uint8 id_errors[64];
+    extern uint16 error_counts[8];
+    extern uint16 status_counts[4];
+    extern uint16 serial_rx_drops;
+    extern uint16 serial_tx_drops;
+    extern uint8 frame_queue_max;
+    extern uint16 tx_queue_max;
+    extern uint16 change_filter_evictions;
+  } // namespace stats_private
+
+  // Кадр поставлен в очередь приема (или отброшен при ее переполнении). Вызывается
+  // из ISR приема после проверки кадра.
+  static inline void countFrame(const LinFrame &frame)
+  {
+    using namespace stats_private;
+    const uint8 status = frame.status();
+    if (status != LinFrame::kStatusPidParity)
+    {
+      const uint8 id = frame.get_byte(0) & 0x3f;
+      if (status == LinFrame::kStatusOk)
+      {
+        id_frames[id]++;
+        return;
+      }
+      if (id_errors[id] != 0xff)
+      {
+        id_errors[id]++;
+      }
+    }
+    status_counts[status - 1]++;
+  }
+
+  // Вызывается из ISR приема с битами lin_processor::errors.
+  static inline void countErrors(uint8 flags)
+  {
+    for (uint8 i = 0; flags; i++, flags >>= 1)
+    {
+      if (flags & 1)
+      {
+        stats_private::error_counts[i]++;
+      }
+    }
+  }
+
+  // Байт от хоста отброшен, входной буфер заполнен. Вызывается из USART_RX_vect.
+  static inline void countSerialRxDrop()
+  {
+    stats_private::serial_rx_drops++;
+  }
+
+  // Байты к хосту отброшены, выходной буфер заполнен. Вызывается из main.
+  static inline void countSerialTxDrops(uint8 num_bytes)
+  {
+    stats_private::serial_tx_drops += num_bytes;
+  }
+
+  // Занято байтов очереди кадров приема. Вызывается из ISR приема.
+  static inline void updateFrameQueueUsage(uint8 num_bytes)
+  {
+    if (num_bytes > stats_private::frame_queue_max)
+    {
+      stats_private::frame_queue_max = num_bytes;
+    }
+  }
+
+  // Занято байтов выходного буфера sio. Вызывается из main с запрещенными
+  // прерываниями.
+  static inline void updateTxQueueUsage(uint16 num_bytes)
+  {
+    if (num_bytes > stats_private::tx_queue_max)
+    {
+      stats_private::tx_queue_max = num_bytes;
+    }
+  }
+
+  // Новый ID вытеснил из кеша change_filter запись самого давнего ID. Вызывается
+  // из main.
+  static inline void countChangeFilterEviction()
+  {
+    stats_private::change_filter_evictions++;
+  }
+
+  // Начать вывод счетчиков (команда I). Строки выводятся из loop(), когда
+  // помещаются в выходной буфер. reset - обнулять счетчики по мере вывода, так что
+  // ни одно событие не теряется между выводом и сбросом. Время работы не
+  // сбрасывается.
+  extern void startDump(boolean reset);
+
+  // Вызывается из основного цикла.
+  extern void loop();
+} // namespace stats
+
+#endif
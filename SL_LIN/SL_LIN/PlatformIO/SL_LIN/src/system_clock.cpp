@@ -8,11 +8,25 @@ namespace system_clock {
 static const uint16 kTicksPerMilli = hardware_clock::kTicksPerMilli;
 static const uint16 kTicksPer10Millis = 10 * kTicksPerMilli;
 
+// Тики, учтенные в time_millis (кратно миллисекундам).
 static uint16 accounted_ticks = 0;
 static uint32 time_millis = 0;
 
+namespace system_clock_private {
+// Значение аппаратных часов при последнем loop() и его 32-битное расширение.
+// Читаются ISR (extendTicksForIsr()), пишутся здесь с запрещенными прерываниями.
+uint16 last_ticks = 0;
+uint32 time_ticks = 0;
+}  // namespace system_clock_private
+
+using namespace system_clock_private;
+
 void loop() {
-  const uint16 current_ticks = hardware_clock::ticksForNonIsr();
+  cli();
+  const uint16 current_ticks = hardware_clock::ticksForIsr();
+  time_ticks += (uint16)(current_ticks - last_ticks);
+  last_ticks = current_ticks;
+  sei();
 
   // Эта 16-битная беззнаковая арифметика хорошо работает и в случае переполнения таймера.
   // Предположим, что на каждый цикл таймера приходится не менее двух циклов.
@@ -38,4 +52,19 @@ uint32 timeMillis() {
   return time_millis;
 }
 
+uint32 timeTicks() {
+  return time_ticks;
+}
+
+uint32 ticksToMillis(uint32 ticks) {
+  // Тики от accounted_ticks, которому соответствует ровно time_millis. ticks и
+  // time_ticks в одной шкале, last_ticks не раньше accounted_ticks.
+  const int32 delta_ticks = (int32)(ticks - time_ticks) + (uint16)(last_ticks - accounted_ticks);
+  // Округление вниз и для отрицательной разности.
+  if (delta_ticks >= 0) {
+    return time_millis + delta_ticks / kTicksPerMilli;
+  }
+  return time_millis - ((kTicksPerMilli - 1) - delta_ticks) / kTicksPerMilli;
+}
+
 }  // пространство имен system_clock
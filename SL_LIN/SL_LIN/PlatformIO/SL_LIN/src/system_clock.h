@@ -7,6 +7,12 @@
 // Использует аппаратные часы для обеспечения 32-битного миллисекундного времени с момента запуска программы.
 // Время цикла 32 миллисекунды составляет около 54 дней цикла.
 namespace system_clock {
+// Частные данные. Не использовать из других модулей.
+namespace system_clock_private {
+extern uint16 last_ticks;
+extern uint32 time_ticks;
+}  // namespace system_clock_private
+
 // Вызов один раз для основного цикла(). Обновляет внутренние часы миллисекунд на основе аппаратного обеспечения.
 // Часы. Интервал вызова более 280 мс приведет к потере времени из-за
 // к переполнению аппаратных часов.
@@ -16,6 +22,26 @@ extern void loop();
 // никогда не вызывается.
 extern uint32 timeMillis();
 
+// Время последнего loop() в тиках hardware_clock (4 мкс) с момента запуска программы.
+// Цикл около 4,8 часа.
+extern uint32 timeTicks();
+
+// Расширяет 16-битное значение hardware_clock до 32 бит в шкале timeTicks().
+// Значение должно быть снято не более чем за ~130 мс до или после последнего
+// loop(), поэтому метку времени кадра расширяет ISR, когда кадр готов, а не main
+// при выводе: кадр может ждать в очереди сколько угодно.
+// ВЫЗЫВАТЬ ЭТО ТОЛЬКО ИЗ ISR.
+inline uint32 extendTicksForIsr(uint16 ticks) {
+  using namespace system_clock_private;
+  // Знаковая разность: метка может быть немного новее последнего loop().
+  return time_ticks + (int16)(ticks - last_ticks);
+}
+
+// Переводит время в шкале timeTicks() (например, расширенную метку кадра) в шкалу
+// timeMillis(). Время должно отличаться от последнего loop() меньше чем на ~2,4
+// часа.
+extern uint32 ticksToMillis(uint32 ticks);
+
 }  // пространство имен system_clock
 
 #endif
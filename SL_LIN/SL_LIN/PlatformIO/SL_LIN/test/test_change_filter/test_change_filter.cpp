@@ -0,0 +1,72 @@
+// Кеш режима изменений (change_filter) на хосте. Собирается в [env:native_test]:
+//
+//   pio test -e native_test
+//
+// Кадры собираются в LinFrame так же, как это делает ISR приема.
+
+#include <unity.h>
+
+#include "change_filter.h"
+#include "lin_frame.h"
+#include "lin_ids.h"
+#include "stats.h"
+
+// Кадр ID id с одним байтом данных value и суммой.
+static LinFrame frame(uint8 id, uint8 value) {
+  LinFrame result;
+  result.append_byte(lin_ids::protectedId(id));
+  result.append_byte(value);
+  result.append_byte(0);
+  return result;
+}
+
+static boolean accept(uint8 id, uint8 value) {
+  return change_filter::acceptFrame(frame(id, value));
+}
+
+void setUp() {
+  change_filter::setEnabled(true, 0);
+  stats::stats_private::change_filter_evictions = 0;
+}
+
+void tearDown() {}
+
+static void test_repeats_are_suppressed() {
+  TEST_ASSERT_TRUE(accept(0x10, 1));
+  TEST_ASSERT_FALSE(accept(0x10, 1));
+  TEST_ASSERT_TRUE(accept(0x10, 2));
+  TEST_ASSERT_FALSE(accept(0x10, 2));
+}
+
+static void test_ids_past_the_cache_are_filtered() {
+  for (uint8 id = 0; id < change_filter::kMaxCachedIds + 8; id++) {
+    TEST_ASSERT_TRUE(accept(id, 1));
+  }
+  // Последние ID в кеше, их повторы подавляются.
+  for (uint8 id = 8; id < change_filter::kMaxCachedIds + 8; id++) {
+    TEST_ASSERT_FALSE(accept(id, 1));
+  }
+  TEST_ASSERT_EQUAL_UINT8(change_filter::kMaxCachedIds, change_filter::numCachedIds());
+  TEST_ASSERT_EQUAL_UINT16(8, stats::stats_private::change_filter_evictions);
+}
+
+static void test_least_recently_seen_id_is_evicted() {
+  for (uint8 id = 0; id < change_filter::kMaxCachedIds; id++) {
+    TEST_ASSERT_TRUE(accept(id, 1));
+  }
+  // ID 0 снова на шине, самым давним стал ID 1.
+  TEST_ASSERT_FALSE(accept(0, 1));
+  TEST_ASSERT_TRUE(accept(0x3f, 1));
+  TEST_ASSERT_FALSE(accept(0, 1));
+  TEST_ASSERT_FALSE(accept(0x3f, 1));
+  // Запись ID 1 отдана ID 3F: его кадр снова выводится.
+  TEST_ASSERT_TRUE(accept(1, 1));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_repeats_are_suppressed);
+  RUN_TEST(test_ids_past_the_cache_are_filtered);
+  RUN_TEST(test_least_recently_seen_id_is_evicted);
+  return UNITY_END();
+}
@@ -0,0 +1,150 @@
+// Разбор команд lawicel на хосте: строки, которые должны получить BEL, а не
+// попасть в таблицы. Собирается в [env:native_test]:
+//
+//   pio test -e native_test
+//
+// Команда подается по символу в lawicel::processChar(), ответ читается из
+// выходного буфера sio вызовами USART_UDRE_vect(), как это делал бы UART.
+
+#include <unity.h>
+
+#include <string>
+
+#include "avr_util.h"
+#include "lawicel.h"
+#include "lin_processor.h"
+#include "scheduler.h"
+#include "sio.h"
+
+extern "C" void USART_UDRE_vect(void);
+
+static const char kOk[] = "\r";
+static const char kBel[] = "\a";
+
+// Передать строку с CR и вернуть ответ устройства.
+static std::string command(const char *line) {
+  for (const char *p = line; *p; p++) {
+    lawicel::processChar(*p);
+  }
+  lawicel::processChar('\r');
+  std::string reply;
+  while (UCSR0B & H(UDRIE0)) {
+    USART_UDRE_vect();
+    reply += (char)UDR0;
+  }
+  return reply;
+}
+
+void setUp() {
+  sio::setup();
+  scheduler::clear();
+  lin_processor::clearResponses();
+}
+
+void tearDown() {}
+
+// ----- K: таблица периодической передачи -----
+
+static void test_schedule_accepts_valid_entries() {
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Kt0012AABB0064").c_str());
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Kt03D00001").c_str());
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Kt013811223344556677887FFF").c_str());
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Ku0012CCDD").c_str());
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Kd013").c_str());
+}
+
+static void test_schedule_rejects_wrong_length() {
+  // Одной цифры периода не хватает, одна лишняя.
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kt0012AABB064").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kt0012AABB00640").c_str());
+  // Данных меньше, чем l.
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kt0013AABB0064").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kt00").c_str());
+  // Ku без периода: лишние цифры.
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Kt0012AABB0064").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Ku0012CCDD0064").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kd01").c_str());
+}
+
+static void test_schedule_rejects_out_of_range_fields() {
+  // ID выше байта, больше 8 байтов данных.
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kt1001AA0064").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kt0129112233445566778899").c_str());
+  // Нет такого ID для Ku и Kd.
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Ku0021AA").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kd002").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kx").c_str());
+}
+
+static void test_schedule_rejects_period_overflow() {
+  // Период 1..7FFF мс: 0 и больше 7FFF переполнили бы знаковое сравнение времени.
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kt0011AA0000").c_str());
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Kt0011AA7FFF").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kt0021AA8000").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kt0021AAFFFF").c_str());
+  // Отклоненная строка не заменяет существующую запись.
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kt0011AA8000").c_str());
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Kd001").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Kd002").c_str());
+}
+
+// ----- J: таблица ответов -----
+
+static void test_response_accepts_valid_entries() {
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Jt0011AA").c_str());
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Jt00C81122334455667788").c_str());
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Jd001").c_str());
+  TEST_ASSERT_EQUAL_STRING(kOk, command("Jc").c_str());
+}
+
+static void test_response_rejects_wrong_length() {
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Jt0012AA").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Jt0011AABB").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Jt001").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Jd01").c_str());
+}
+
+static void test_response_rejects_out_of_range_fields() {
+  // ID выше байта, без данных, больше 8 байтов данных.
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Jt1001AA").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Jt0010").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Jt0019112233445566778899").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Jd002").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("Jx").c_str());
+}
+
+static void test_response_rejects_full_table() {
+  char line[] = "Jt0001AA";
+  for (char id = '0'; id < '8'; id++) {
+    line[4] = id;
+    TEST_ASSERT_EQUAL_STRING(kOk, command(line).c_str());
+  }
+  line[4] = '8';
+  TEST_ASSERT_EQUAL_STRING(kBel, command(line).c_str());
+  // Замена данных существующего ID места не требует.
+  line[4] = '0';
+  TEST_ASSERT_EQUAL_STRING(kOk, command(line).c_str());
+}
+
+// ----- G: автоопределение скорости -----
+
+static void test_autobaud_rejects_bad_mode() {
+  TEST_ASSERT_EQUAL_STRING(kBel, command("G3").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("G").c_str());
+  TEST_ASSERT_EQUAL_STRING(kBel, command("G10").c_str());
+  TEST_ASSERT_EQUAL_STRING(kOk, command("G0").c_str());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_schedule_accepts_valid_entries);
+  RUN_TEST(test_schedule_rejects_wrong_length);
+  RUN_TEST(test_schedule_rejects_out_of_range_fields);
+  RUN_TEST(test_schedule_rejects_period_overflow);
+  RUN_TEST(test_response_accepts_valid_entries);
+  RUN_TEST(test_response_rejects_wrong_length);
+  RUN_TEST(test_response_rejects_out_of_range_fields);
+  RUN_TEST(test_response_rejects_full_table);
+  RUN_TEST(test_autobaud_rejects_bad_mode);
+  return UNITY_END();
+}
@@ -0,0 +1,76 @@
+// Выучивание типа контрольной суммы по ID (lin_ids) на хосте. Собирается в
+// [env:native_test]:
+//
+//   pio test -e native_test
+
+#include <unity.h>
+
+#include "custom_defs.h"
+#include "lin_ids.h"
+
+static const uint8 kId = 0x10;
+
+// Кадр ID kId, сумма которого совпала с классической или с расширенной.
+static boolean classicFrame() {
+  return lin_ids::acceptChecksum(kId, false, true);
+}
+
+static boolean enhancedFrame() {
+  return lin_ids::acceptChecksum(kId, true, false);
+}
+
+void setUp() {
+  lin_ids::resetChecksumModels();
+}
+
+void tearDown() {}
+
+static void test_model_is_learned_after_confirm_frames() {
+  for (uint8 i = 0; i < lin_ids::kModelConfirmFrames; i++) {
+    TEST_ASSERT_EQUAL(custom_defs::kUseLinChecksumVersion2, lin_ids::usesEnhancedChecksum(kId));
+    TEST_ASSERT_TRUE(classicFrame());
+  }
+  TEST_ASSERT_FALSE(lin_ids::usesEnhancedChecksum(kId));
+  TEST_ASSERT_FALSE(enhancedFrame());
+  TEST_ASSERT_FALSE(lin_ids::acceptChecksum(kId, false, false));
+}
+
+static void test_single_corrupted_frame_does_not_fix_model() {
+  // Первый кадр с "неправильным" типом не закрепляет его.
+  TEST_ASSERT_TRUE(enhancedFrame());
+  for (uint8 i = 0; i < lin_ids::kModelConfirmFrames + 1; i++) {
+    TEST_ASSERT_TRUE(classicFrame());
+  }
+  TEST_ASSERT_FALSE(lin_ids::usesEnhancedChecksum(kId));
+  TEST_ASSERT_FALSE(enhancedFrame());
+}
+
+static void test_model_is_relearned_after_mismatches() {
+  for (uint8 i = 0; i < 10; i++) {
+    classicFrame();
+  }
+  // Уверенность насыщена (7): первые несовпадения отбрасываются, седьмое меняет
+  // тип, еще два его подтверждают.
+  TEST_ASSERT_FALSE(enhancedFrame());
+  for (uint8 i = 1; i < 9; i++) {
+    enhancedFrame();
+  }
+  TEST_ASSERT_TRUE(lin_ids::usesEnhancedChecksum(kId));
+  TEST_ASSERT_FALSE(classicFrame());
+}
+
+static void test_diagnostic_ids_stay_classic() {
+  for (uint8 i = 0; i < 10; i++) {
+    lin_ids::acceptChecksum(0x3c, true, false);
+  }
+  TEST_ASSERT_FALSE(lin_ids::usesEnhancedChecksum(0x3c));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_model_is_learned_after_confirm_frames);
+  RUN_TEST(test_single_corrupted_frame_does_not_fix_model);
+  RUN_TEST(test_model_is_relearned_after_mismatches);
+  RUN_TEST(test_diagnostic_ids_stay_classic);
+  return UNITY_END();
+}